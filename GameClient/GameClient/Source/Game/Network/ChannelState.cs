@@ -0,0 +1,197 @@
+﻿using System;
+
+namespace Game
+{
+    // Delivery guarantees of a message, picked per packet type
+    public enum Channel : byte
+    {
+        Unreliable,             // Fire and forget
+        UnreliableSequenced,    // Fire and forget, anything older than the latest received of its stream is dropped
+        ReliableUnordered,      // Resent until acknowledged, handled as soon as it arrives
+        ReliableOrdered         // Resent until acknowledged, handled in the order it was sent within its stream
+    }
+
+    // Independent streams of sequenced and ordered messages, a message only waits for or supersedes messages of its own stream
+    public enum ChannelStream : byte
+    {
+        Session,
+        Entities,
+        Chat,
+        Map,
+        Snapshot,
+        MAX_SIZE    // Has to be last
+    }
+
+    // Whether a received message is acknowledged and handled
+    public enum Admission
+    {
+        Accept,     // Acknowledge and handle
+        Duplicate,  // Acknowledge but do not handle, it was handled already or got superseded
+        Refuse      // Neither, it is too far ahead of its ordered stream and has to be resent later
+    }
+
+    public struct ChannelInfo
+    {
+        public Channel channel;
+        public ChannelStream stream;
+
+        public ChannelInfo(Channel channel, ChannelStream stream)
+        {
+            this.channel = channel;
+            this.stream = stream;
+        }
+
+        public bool IsSequenced() => channel == Channel.UnreliableSequenced || channel == Channel.ReliableOrdered;
+    }
+
+    // Channel sequences of the messages the server sends us. Sequenced messages are dropped when stale, ordered ones
+    // are held back until every message before them in their stream has been handled. Channel sequence 0 marks a message
+    // sent without sequencing, it is always handled right away.
+    // Only called from the receive callback, which never runs twice at the same time
+    public class ChannelState
+    {
+        public const ushort OrderedWindow = 64;    // Max amount of messages held back per ordered stream, has to match the server
+
+        private ushort[] m_Latest = new ushort[(int)ChannelStream.MAX_SIZE];
+        private ushort[] m_Expected = new ushort[(int)ChannelStream.MAX_SIZE];
+        private NetworkMessage[][] m_Pending = new NetworkMessage[(int)ChannelStream.MAX_SIZE][];
+
+        public ChannelState()
+        {
+            for (int i = 0; i < (int)ChannelStream.MAX_SIZE; ++i)
+            {
+                m_Expected[i] = 1;
+                m_Pending[i] = new NetworkMessage[OrderedWindow];
+            }
+        }
+
+        // Channel and stream of a packet type, both ends have to agree on these
+        public static ChannelInfo GetChannel(PacketType type)
+        {
+            switch (type)
+            {
+                case PacketType.Disconnect:
+                case PacketType.HandShake:
+                    return new ChannelInfo(Channel.ReliableOrdered, ChannelStream.Session);
+                case PacketType.PlayerData:
+                case PacketType.RemoveCreature:
+                    return new ChannelInfo(Channel.ReliableOrdered, ChannelStream.Entities);
+                case PacketType.Notify:
+                    return new ChannelInfo(Channel.ReliableUnordered, ChannelStream.Session);
+                case PacketType.Message:
+                    return new ChannelInfo(Channel.ReliableOrdered, ChannelStream.Chat);
+                case PacketType.MapSector:
+                case PacketType.MapData:
+                case PacketType.UnloadMapData:
+                    return new ChannelInfo(Channel.ReliableOrdered, ChannelStream.Map);
+                case PacketType.Snapshot:
+                    return new ChannelInfo(Channel.UnreliableSequenced, ChannelStream.Snapshot);
+                default:
+                    // Movement and Rotation included, their payload carries the tick telling stale updates apart per entity.
+                    // Fragments are not reassembled yet, so they never reach a stream
+                    return new ChannelInfo(Channel.Unreliable, ChannelStream.Session);
+            }
+        }
+
+        // Decide before acknowledging a message
+        public Admission Admit(PacketType type, ushort channel_sequence)
+        {
+            ChannelInfo info = GetChannel(type);
+            if (channel_sequence == 0 || !info.IsSequenced())
+                return Admission.Accept;
+
+            int stream = (int)info.stream;
+            if (info.channel == Channel.UnreliableSequenced)
+            {
+                ushort latest = m_Latest[stream];
+                return latest == 0 || Network.IsSequenceNewer(channel_sequence, latest) ? Admission.Accept : Admission.Duplicate;
+            }
+
+            ushort expected = m_Expected[stream];
+            if (Network.IsSequenceNewer(expected, channel_sequence))
+                return Admission.Duplicate;
+
+            return Distance(expected, channel_sequence) < OrderedWindow ? Admission.Accept : Admission.Refuse;
+        }
+
+        // Hand an admitted message to handle, followed by any held back messages it released. Takes ownership of msg
+        public void Deliver(NetworkMessage msg, Action<NetworkMessage> handle)
+        {
+            ChannelInfo info = GetChannel(msg.GetPacketType());
+            ushort channel_sequence = msg.GetChannelSequence();
+            if (channel_sequence == 0 || !info.IsSequenced())
+            {
+                Handle(msg, handle);
+                return;
+            }
+
+            int stream = (int)info.stream;
+            if (info.channel == Channel.UnreliableSequenced)
+            {
+                if (m_Latest[stream] == 0 || Network.IsSequenceNewer(channel_sequence, m_Latest[stream]))
+                {
+                    m_Latest[stream] = channel_sequence;
+                    Handle(msg, handle);
+                }
+                else
+                {
+                    msg.Dispose();
+                }
+                return;
+            }
+
+            ushort expected = m_Expected[stream];
+            ushort distance = Distance(expected, channel_sequence);
+            if (Network.IsSequenceNewer(expected, channel_sequence) || distance >= OrderedWindow)
+            {
+                msg.Dispose();
+                return;
+            }
+
+            NetworkMessage[] pending = m_Pending[stream];
+            if (distance > 0)
+            {
+                // Wait for our turn, a resent copy of a message already held back is dropped
+                int slot = channel_sequence % OrderedWindow;
+                if (pending[slot] == null || pending[slot].GetChannelSequence() != channel_sequence)
+                {
+                    pending[slot]?.Dispose();
+                    pending[slot] = msg;
+                }
+                else
+                {
+                    msg.Dispose();
+                }
+                return;
+            }
+
+            expected = NextSequence(expected);
+            Handle(msg, handle);
+            while (pending[expected % OrderedWindow] is NetworkMessage released && released.GetChannelSequence() == expected)
+            {
+                pending[expected % OrderedWindow] = null;
+                expected = NextSequence(expected);
+                Handle(released, handle);
+            }
+            m_Expected[stream] = expected;
+        }
+
+        private static void Handle(NetworkMessage msg, Action<NetworkMessage> handle)
+        {
+            handle(msg);
+            msg.Dispose();
+        }
+
+        // Steps from expected to sequence skipping 0, which is never used for sequenced messages
+        private static ushort Distance(ushort expected, ushort sequence)
+        {
+            ushort distance = (ushort)(sequence - expected);
+            return sequence < expected ? (ushort)(distance - 1) : distance;
+        }
+
+        private static ushort NextSequence(ushort sequence)
+        {
+            return sequence == ushort.MaxValue ? (ushort)1 : (ushort)(sequence + 1);
+        }
+    }
+}
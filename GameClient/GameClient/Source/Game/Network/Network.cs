@@ -17,14 +17,20 @@ namespace Game
         public ushort port = 7171;
 
         private RpcManager m_Rpc;
+        private ChannelState m_Channels = new ChannelState();
         private uint m_Id;
         private static UdpClient m_UdpClient;
         private IPEndPoint m_EndPoint;
-        private List<uint> m_RecentMsgs = new List<uint>();
+        private readonly object m_AckLock = new object();
+        private ushort m_Sequence;
+        private ushort m_RemoteSequence;
+        private uint m_RemoteAckBits;
+        private bool m_AckPending;
         private int m_ReceivedBytes;
         private int m_SentBytes;
+        private float m_HandShakeTimer;
 
-        public ulong latency;
+        public ulong latency;   // Smoothed roundtrip time in milliseconds, sent by the server with every Ping
 
         public uint GetId() => m_Id;
         public void SetId(uint id)
@@ -44,8 +50,27 @@ namespace Game
 
             m_UdpClient.BeginReceive(Listen, m_UdpClient);
 
-            NetworkMessage msg = new NetworkMessage(PacketType.HandShake);
-            Send(msg);
+            SendHandShake(new byte[NetworkMessage.CookieSize]);
+        }
+
+        public override void OnUpdate()
+        {
+            // Start over until the server assigned us an id, either HandShake or its Challenge can get lost
+            if (m_Id == 0)
+            {
+                m_HandShakeTimer += Time.DeltaTime;
+                if (m_HandShakeTimer >= 1.0f)
+                {
+                    SendHandShake(new byte[NetworkMessage.CookieSize]);
+                }
+            }
+
+            // Reliable messages are acknowledged in the header of whatever we send next,
+            // only send a bare Acknowledge when nothing else went out since they arrived
+            if (m_AckPending)
+            {
+                Send(new NetworkMessage(PacketType.Acknowledge));
+            }
         }
 
         public override void OnDestroy()
@@ -62,26 +87,55 @@ namespace Game
         {
             byte[] data = m_UdpClient.EndReceive(ar, ref m_EndPoint);
 
-            if (data.Length > 0)
+            if (data.Length >= NetworkMessage.PacketHeaderSize)
             {
                 m_ReceivedBytes += data.Length;
                 Debug.Log($"Recv total: {m_ReceivedBytes} bytes | {(m_ReceivedBytes * 0.008f):0.00}k/bit || Sent total: {m_SentBytes} bytes | {(m_SentBytes * 0.008f):0.00}k/bit");
-                NetworkMessage msg = new NetworkMessage(data);
-                //Debug.Log($"Recv Type: {msg.GetPacketType()} Sequence: {msg.GetSequenceId()}");
-                if (m_RecentMsgs.Contains(msg.GetSequenceId()))
-                {
-                    SendAck(msg.GetSequenceId());
-                }
-                else
+
+                // The server bundles the messages of a tick into one datagram
+                int offset = NetworkMessage.PacketHeaderSize;
+                while (offset + NetworkMessage.HeaderSize <= data.Length)
                 {
-                    m_Rpc.Invoke(this, msg);
+                    int size = NetworkMessage.HeaderSize + BitConverter.ToUInt16(data, offset + 2);
+                    if (offset + size > data.Length)
+                        break;
+
+                    NetworkMessage msg = new NetworkMessage(data, offset, size);
+                    offset += size;
+                    //Debug.Log($"Recv Type: {msg.GetPacketType()} Sequence: {msg.GetSequenceId()}");
+
+                    // Messages too far ahead of their ordered stream are not acknowledged so they get resent later
+                    Admission admission = m_Channels.Admit(msg.GetPacketType(), msg.GetChannelSequence());
+                    if (admission == Admission.Refuse)
+                    {
+                        msg.Dispose();
+                        continue;
+                    }
+
+                    // Duplicated datagrams and superseded messages are acknowledged but never handled
+                    bool is_new = msg.GetSequenceId() == 0 || Received(msg.GetSequenceId());
+                    if (!is_new || admission == Admission.Duplicate)
+                    {
+                        msg.Dispose();
+                        continue;
+                    }
+
+                    m_Channels.Deliver(msg, (released) => m_Rpc.Invoke(this, released));
                 }
-                msg.Dispose();
             }
 
             m_UdpClient.BeginReceive(Listen, m_UdpClient);
         }
 
+        // HandShake of a client without a connection, padded to the size of the Challenge it is answered with
+        public void SendHandShake(byte[] cookie)
+        {
+            m_HandShakeTimer = 0.0f;
+            NetworkMessage msg = new NetworkMessage(PacketType.HandShake);
+            msg.Write(cookie);
+            Send(msg);
+        }
+
         public void Send(in NetworkMessage msg, bool reliable = false)
         {
             if (reliable)
@@ -89,25 +143,61 @@ namespace Game
                 // TODO: Store msg
             }
 
-            if (msg.GetSequenceId() == 0)
+            List<byte> data = new List<byte>(NetworkMessage.PacketHeaderSize + msg.GetSize());
+            lock (m_AckLock)
             {
-                msg.AddSequenceId(0);
+                // Every message is numbered so the server can discard duplicated datagrams, 0 is skipped.
+                // The channel sequence stays 0: without resends of our own an ordered stream could never fill a gap,
+                // so the server handles what we send as it arrives
+                m_Sequence = m_Sequence == ushort.MaxValue ? (ushort)1 : (ushort)(m_Sequence + 1);
+                msg.SetHeader(m_Sequence);
+
+                data.AddRange(BitConverter.GetBytes(m_RemoteSequence));
+                data.AddRange(BitConverter.GetBytes(m_RemoteAckBits));
+                m_AckPending = false;
             }
-            List<byte> data = msg.GetData();
+            data.AddRange(msg.GetData());
             m_SentBytes += data.Count;
             Task.Run(() => { m_UdpClient.BeginSend(data.ToArray(), data.Count, (ar) => m_UdpClient.EndSend(ar), m_UdpClient); });
         }
 
-        public void SendAck(uint sequence_id)
+        // Sequence ids and channel sequences wrap around, lhs is newer if it is less than half the range ahead of rhs
+        public static bool IsSequenceNewer(ushort lhs, ushort rhs)
         {
-            if (!m_RecentMsgs.Contains(sequence_id))
+            return lhs != rhs && (ushort)(lhs - rhs) < 0x8000;
+        }
+
+        // Track a received sequence id for the ack header, returns false for duplicates and ids too old to tell
+        private bool Received(ushort sequence_id)
+        {
+            lock (m_AckLock)
             {
-                m_RecentMsgs.Add(sequence_id);
-            }
+                m_AckPending = true;
 
-            NetworkMessage msg = new NetworkMessage(PacketType.Acknowledge);
-            msg.AddSequenceId(sequence_id);
-            Send(msg);
+                if (m_RemoteSequence == 0 || IsSequenceNewer(sequence_id, m_RemoteSequence))
+                {
+                    int shift = (ushort)(sequence_id - m_RemoteSequence);
+                    if (m_RemoteSequence == 0 || shift > 32)
+                        m_RemoteAckBits = 0;
+                    else
+                        m_RemoteAckBits = (uint)(((ulong)m_RemoteAckBits << shift) | (1ul << (shift - 1)));
+
+                    m_RemoteSequence = sequence_id;
+                    return true;
+                }
+
+                if (sequence_id == m_RemoteSequence)
+                    return false;
+
+                int distance = (ushort)(m_RemoteSequence - sequence_id);
+                if (distance > 32)
+                    return false;
+
+                uint bit = 1u << (int)(distance - 1);
+                bool is_new = (m_RemoteAckBits & bit) == 0;
+                m_RemoteAckBits |= bit;
+                return is_new;
+            }
         }
 
         public void Disconnect()
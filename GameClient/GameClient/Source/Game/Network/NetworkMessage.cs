@@ -11,13 +11,33 @@ namespace Game
         HandShake,
         Acknowledge,
         Ping,
+        Challenge,
+        Notify,
+        Message,
+        PlayerData,
+        Movement,
+        RemoveCreature,
+        Rotation,
+        MapSector,
+        MapData,
+        UnloadMapData,
+        Snapshot,
+        Fragment,
         MAX_SIZE    // Has to be last
     }
 
     public class NetworkMessage : IDisposable
     {
+        // Datagram header: latest received sequence id (ushort), ack bitfield (uint)
+        public const int PacketHeaderSize = 6;
+        // Message header: packet type (ushort), payload length (ushort), sequence id (ushort), channel sequence (ushort)
+        public const int HeaderSize = 8;
+        // HandShake payload until connected: cookie issue time (uint), cookie MAC (ulong), zeros before the server sent one
+        public const int CookieSize = 12;
+
         private List<byte> m_Data;
-        private uint m_SequenceId = 0;
+        private ushort m_SequenceId = 0;
+        private ushort m_ChannelSequence = 0;
         private PacketType m_Type;
         private int m_Index = 0;
         private int m_Size = 0;
@@ -27,29 +47,39 @@ namespace Game
             m_Data = new List<byte>();
             m_Type = type;
             Write((ushort)m_Type);
+            Write((ushort)0);
+            Write(m_SequenceId);
+            Write(m_ChannelSequence);
         }
 
-        public NetworkMessage(in byte[] data)
+        // Message starting at offset within a received datagram
+        public NetworkMessage(in byte[] data, int offset, int size)
         {
-            m_Data = new List<byte>(data);
-            m_Size = (ushort)data.Length;
-            m_SequenceId = ReadUInt();
+            m_Data = new List<byte>(new ArraySegment<byte>(data, offset, size));
+            m_Size = size;
             m_Type = (PacketType)ReadUShort();
+            ReadUShort();
+            m_SequenceId = ReadUShort();
+            m_ChannelSequence = ReadUShort();
         }
 
         public PacketType GetPacketType() => m_Type;
         public List<byte> GetData() => m_Data;
         public int GetSize() => m_Size;
-        public uint GetSequenceId() => m_SequenceId;
+        public ushort GetSequenceId() => m_SequenceId;
+        // Position within the message's ordered or sequenced stream, 0 if it is not sequenced
+        public ushort GetChannelSequence() => m_ChannelSequence;
 
-        public void AddSequenceId(uint id)
+        public void SetHeader(ushort sequence_id)
         {
-            m_SequenceId = id;
-
-            m_Data.InsertRange(0, BitConverter.GetBytes(m_SequenceId));
+            m_SequenceId = sequence_id;
 
-            m_Size = m_Data.Count;
-            m_Index = m_Size;
+            byte[] length = BitConverter.GetBytes((ushort)(m_Data.Count - HeaderSize));
+            byte[] sequence = BitConverter.GetBytes(sequence_id);
+            m_Data[2] = length[0];
+            m_Data[3] = length[1];
+            m_Data[4] = sequence[0];
+            m_Data[5] = sequence[1];
         }
         public void Write(byte value)
         {
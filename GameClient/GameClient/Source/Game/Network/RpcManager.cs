@@ -15,6 +15,7 @@ namespace Game
             m_RpcList.Add(PacketType.Disconnect, Disconnect);
             m_RpcList.Add(PacketType.HandShake, HandShake);
             m_RpcList.Add(PacketType.Ping, Ping);
+            m_RpcList.Add(PacketType.Challenge, Challenge);
         }
 
         public void Invoke(Network network, NetworkMessage msg)
@@ -22,10 +23,6 @@ namespace Game
             PacketType type = msg.GetPacketType();
             if (m_RpcList.ContainsKey(type))
             {
-                if (msg.GetSequenceId() > 0)
-                {
-                    network.SendAck(msg.GetSequenceId());
-                }
                 Task.Run(() => m_RpcList[type].Invoke(network, msg)).Wait();
             }
 
@@ -48,6 +45,13 @@ namespace Game
             network.Send(msg);
         }
 
+        // The server only opens a connection once we echo the cookie it sent
+        private void Challenge(Network network, NetworkMessage msg)
+        {
+            byte[] cookie = msg.ReadBytes(NetworkMessage.CookieSize);
+            network.SendHandShake(cookie);
+        }
+
         private void Ping(Network network, NetworkMessage msg)
         {
             ulong latency = msg.ReadULong();
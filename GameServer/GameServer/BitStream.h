@@ -0,0 +1,246 @@
+#pragma once
+#include <bit>
+#include <cmath>
+#include <algorithm>
+#include "NetworkMessage.h"
+#include "NetworkMessageReader.h"
+
+const uint32_t QUATERNION_COMPONENT_BITS = 10;		// Bits per component of a smallest three quaternion, 2 + 3 * 10 = 32 bits in total
+const float QUATERNION_COMPONENT_BOUND = 0.707107f;	// All but the largest component of a unit quaternion are within +-1/sqrt(2)
+const uint32_t QUATERNION_COMPONENT_STEPS = (1 << QUATERNION_COMPONENT_BITS) - 2;	// Even step count so zero is exact
+
+// Amount of bits needed to store every value in [0, range]
+constexpr uint32_t BitsRequired(uint32_t range)
+{
+	return std::max<uint32_t>(1, std::bit_width(range));
+}
+
+// Amount of quantization steps covering [min, max] with the given precision
+inline uint32_t QuantizationSteps(float min, float max, float precision)
+{
+	return (uint32_t)std::ceil((max - min) / precision);
+}
+
+// Map a float in [min, max] to one of steps + 1 evenly spaced values, values outside are clamped
+inline uint32_t Quantize(float value, float min, float max, uint32_t steps)
+{
+	float quantized = std::round((std::clamp(value, min, max) - min) / (max - min) * steps);
+	return std::min((uint32_t)quantized, steps);
+}
+
+inline float Dequantize(uint32_t value, float min, float max, uint32_t steps)
+{
+	return min + (max - min) * std::min(value, steps) / steps;
+}
+
+// Smallest three: index of the largest component followed by the other three, the largest is implied by unit length
+inline uint32_t PackQuaternion(const Quaternion& value)
+{
+	float components[] = { value.x, value.y, value.z, value.w };
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; ++i)
+	{
+		if (std::fabs(components[i]) > std::fabs(components[largest]))
+		{
+			largest = i;
+		}
+	}
+
+	// q and -q are the same rotation, flip so the dropped component is positive
+	float sign = components[largest] < 0.f ? -1.f : 1.f;
+
+	uint32_t packed = largest;
+	uint32_t shift = 2;
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		if (i != largest)
+		{
+			packed |= Quantize(components[i] * sign, -QUATERNION_COMPONENT_BOUND, QUATERNION_COMPONENT_BOUND, QUATERNION_COMPONENT_STEPS) << shift;
+			shift += QUATERNION_COMPONENT_BITS;
+		}
+	}
+
+	return packed;
+}
+
+inline Quaternion UnpackQuaternion(uint32_t packed)
+{
+	uint32_t largest = packed & 3;
+	uint32_t shift = 2;
+	float components[4];
+	float sum = 0.f;
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		if (i != largest)
+		{
+			uint32_t value = (packed >> shift) & ((1 << QUATERNION_COMPONENT_BITS) - 1);
+			components[i] = Dequantize(value, -QUATERNION_COMPONENT_BOUND, QUATERNION_COMPONENT_BOUND, QUATERNION_COMPONENT_STEPS);
+			sum += components[i] * components[i];
+			shift += QUATERNION_COMPONENT_BITS;
+		}
+	}
+	components[largest] = std::sqrt(std::max(0.f, 1.f - sum));
+
+	return Quaternion{ components[0], components[1], components[2], components[3] };
+}
+
+// Packs values with the minimum amount of bits into the payload of a NetworkMessage, bits are written LSB first.
+// Flush has to be called once done, after that the message can be written to as usual
+class BitWriter
+{
+public:
+	BitWriter(NetworkMessage& msg) : m_Message(msg) {}
+
+	void WriteBits(uint32_t value, uint32_t bits)
+	{
+		m_Scratch |= (uint64_t)(value & (uint32_t)((1ull << bits) - 1)) << m_ScratchBits;
+		m_ScratchBits += bits;
+
+		while (m_ScratchBits >= 8)
+		{
+			m_Message.Write((uint8_t)m_Scratch);
+			m_Scratch >>= 8;
+			m_ScratchBits -= 8;
+		}
+	}
+
+	void WriteBool(bool value)
+	{
+		WriteBits(value ? 1 : 0, 1);
+	}
+
+	// Write an unsigned integer that is usually small, 17 bits below 65536 and 33 bits otherwise
+	void WriteCompactUint(uint32_t value)
+	{
+		bool small = value <= UINT16_MAX;
+		WriteBool(small);
+		WriteBits(value, small ? 16 : 32);
+	}
+
+	// Write an integer in [min, max], values outside are clamped
+	void WriteInt(int32_t value, int32_t min, int32_t max)
+	{
+		value = std::clamp(value, min, max);
+		WriteBits((uint32_t)((int64_t)value - min), BitsRequired((uint32_t)((int64_t)max - min)));
+	}
+
+	// Write a float in [min, max] quantized to steps of precision
+	void WriteFloat(float value, float min, float max, float precision)
+	{
+		WriteQuantized(value, min, max, QuantizationSteps(min, max, precision));
+	}
+
+	// Write a float in [min, max] as one of steps + 1 evenly spaced values
+	void WriteQuantized(float value, float min, float max, uint32_t steps)
+	{
+		WriteBits(Quantize(value, min, max, steps), BitsRequired(steps));
+	}
+
+	void WriteVector3(const Vector3& value, const Vector3& min, const Vector3& max, float precision)
+	{
+		WriteFloat(value.x, min.x, max.x, precision);
+		WriteFloat(value.y, min.y, max.y, precision);
+		WriteFloat(value.z, min.z, max.z, precision);
+	}
+
+	void WriteVector2(const Vector2& value, const Vector2& min, const Vector2& max, float precision)
+	{
+		WriteFloat(value.x, min.x, max.x, precision);
+		WriteFloat(value.y, min.y, max.y, precision);
+	}
+
+	void WriteQuaternion(const Quaternion& value)
+	{
+		WriteBits(PackQuaternion(value), 2 + 3 * QUATERNION_COMPONENT_BITS);
+	}
+
+	// Write out the last partial byte
+	void Flush()
+	{
+		if (m_ScratchBits > 0)
+		{
+			m_Message.Write((uint8_t)m_Scratch);
+		}
+		m_Scratch = 0;
+		m_ScratchBits = 0;
+	}
+
+private:
+	NetworkMessage& m_Message;
+	uint64_t m_Scratch = 0;
+	uint32_t m_ScratchBits = 0;
+};
+
+// Reads values written by BitWriter, reads past the end of the message return zero and mark the reader as overrun
+class BitReader
+{
+public:
+	BitReader(NetworkMessageReader& msg) : m_Message(msg) {}
+
+	uint32_t ReadBits(uint32_t bits)
+	{
+		while (m_ScratchBits < bits)
+		{
+			m_Scratch |= (uint64_t)m_Message.ReadUint8() << m_ScratchBits;
+			m_ScratchBits += 8;
+		}
+
+		uint32_t value = (uint32_t)(m_Scratch & ((1ull << bits) - 1));
+		m_Scratch >>= bits;
+		m_ScratchBits -= bits;
+		return value;
+	}
+
+	bool ReadBool()
+	{
+		return ReadBits(1) != 0;
+	}
+
+	uint32_t ReadCompactUint()
+	{
+		return ReadBits(ReadBool() ? 16 : 32);
+	}
+
+	int32_t ReadInt(int32_t min, int32_t max)
+	{
+		uint32_t value = ReadBits(BitsRequired((uint32_t)((int64_t)max - min)));
+		return (int32_t)std::min<int64_t>((int64_t)min + value, max);
+	}
+
+	float ReadFloat(float min, float max, float precision)
+	{
+		return ReadQuantized(min, max, QuantizationSteps(min, max, precision));
+	}
+
+	float ReadQuantized(float min, float max, uint32_t steps)
+	{
+		return Dequantize(ReadBits(BitsRequired(steps)), min, max, steps);
+	}
+
+	Vector3 ReadVector3(const Vector3& min, const Vector3& max, float precision)
+	{
+		Vector3 ret;
+		ret.x = ReadFloat(min.x, max.x, precision);
+		ret.y = ReadFloat(min.y, max.y, precision);
+		ret.z = ReadFloat(min.z, max.z, precision);
+		return ret;
+	}
+
+	Vector2 ReadVector2(const Vector2& min, const Vector2& max, float precision)
+	{
+		Vector2 ret;
+		ret.x = ReadFloat(min.x, max.x, precision);
+		ret.y = ReadFloat(min.y, max.y, precision);
+		return ret;
+	}
+
+	Quaternion ReadQuaternion()
+	{
+		return UnpackQuaternion(ReadBits(2 + 3 * QUATERNION_COMPONENT_BITS));
+	}
+
+private:
+	NetworkMessageReader& m_Message;
+	uint64_t m_Scratch = 0;
+	uint32_t m_ScratchBits = 0;
+};
@@ -0,0 +1,189 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+// Size classes of pooled message buffers, picked per packet type so small packets do not hold on to MTU sized buffers
+enum class BufferClass : uint8_t
+{
+	Small,
+	Medium,
+	Large,
+	MAX_SIZE	// This need to be last
+};
+
+const size_t BUFFER_CLASS_CAPACITY[(size_t)BufferClass::MAX_SIZE] = { 64, 256, 1200 };
+
+class BufferPool;
+
+// Byte buffer owned by the BufferPool, it goes back to the freelist of its class once the last BufferRef to it
+// is released. Its capacity is kept unless a payload grew it past the capacity of its class
+struct PooledBuffer
+{
+	std::vector<uint8_t> m_Data;
+	std::atomic<uint32_t> m_References{};
+	BufferClass m_Class;
+};
+
+// Reference counted handle to a PooledBuffer, copies share the same buffer
+class BufferRef
+{
+public:
+	BufferRef() = default;
+	BufferRef(const BufferRef& other) : m_Buffer(other.m_Buffer) { AddReference(); }
+	BufferRef(BufferRef&& other) noexcept : m_Buffer(other.m_Buffer) { other.m_Buffer = nullptr; }
+	~BufferRef() { reset(); }
+
+	BufferRef& operator=(const BufferRef& other)
+	{
+		if (m_Buffer != other.m_Buffer)
+		{
+			reset();
+			m_Buffer = other.m_Buffer;
+			AddReference();
+		}
+		return *this;
+	}
+
+	BufferRef& operator=(BufferRef&& other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			m_Buffer = other.m_Buffer;
+			other.m_Buffer = nullptr;
+		}
+		return *this;
+	}
+
+	const std::vector<uint8_t>& operator*() const { return m_Buffer->m_Data; }
+	const std::vector<uint8_t>* operator->() const { return &m_Buffer->m_Data; }
+	explicit operator bool() const { return m_Buffer != nullptr; }
+
+	// Only valid while this is the only reference, shared buffers are immutable
+	std::vector<uint8_t>& GetMutable() { return m_Buffer->m_Data; }
+	uint32_t UseCount() const { return m_Buffer ? m_Buffer->m_References.load() : 0; }
+
+	void reset();
+
+private:
+	friend class BufferPool;
+	explicit BufferRef(PooledBuffer* buffer) : m_Buffer(buffer) { AddReference(); }
+
+	void AddReference()
+	{
+		if (m_Buffer)
+		{
+			m_Buffer->m_References.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	PooledBuffer* m_Buffer = nullptr;
+};
+
+// Thread safe freelists of message buffers shared by every connection, buffers are only allocated on a miss
+// so a steady tick reuses the same buffers over and over
+class BufferPool
+{
+public:
+	static BufferPool& Get()
+	{
+		static BufferPool pool;
+		return pool;
+	}
+
+	~BufferPool()
+	{
+		for (FreeList& free_list : m_FreeLists)
+		{
+			for (PooledBuffer* buffer : free_list.m_Buffers)
+			{
+				delete buffer;
+			}
+		}
+	}
+
+	BufferRef Acquire(BufferClass buffer_class)
+	{
+		FreeList& free_list = m_FreeLists[(size_t)buffer_class];
+		PooledBuffer* buffer = nullptr;
+
+		free_list.m_Mutex.lock();
+		if (!free_list.m_Buffers.empty())
+		{
+			buffer = free_list.m_Buffers.back();
+			free_list.m_Buffers.pop_back();
+		}
+		free_list.m_Mutex.unlock();
+
+		if (buffer)
+		{
+			m_Hits++;
+		}
+		else
+		{
+			m_Misses++;
+			buffer = new PooledBuffer();
+			buffer->m_Class = buffer_class;
+			buffer->m_Data.reserve(BUFFER_CLASS_CAPACITY[(size_t)buffer_class]);
+		}
+
+		uint64_t in_use = ++m_InUse;
+		uint64_t high_water = m_HighWater;
+		while (in_use > high_water && !m_HighWater.compare_exchange_weak(high_water, in_use));
+
+		return BufferRef(buffer);
+	}
+
+	void Release(PooledBuffer* buffer)
+	{
+		buffer->m_Data.clear();
+		m_InUse--;
+
+		// One oversized payload would otherwise pin a large allocation in a small class for good
+		size_t class_capacity = BUFFER_CLASS_CAPACITY[(size_t)buffer->m_Class];
+		if (buffer->m_Data.capacity() > class_capacity)
+		{
+			std::vector<uint8_t>().swap(buffer->m_Data);
+			buffer->m_Data.reserve(class_capacity);
+			m_Shrunk++;
+		}
+
+		FreeList& free_list = m_FreeLists[(size_t)buffer->m_Class];
+		free_list.m_Mutex.lock();
+		free_list.m_Buffers.push_back(buffer);
+		free_list.m_Mutex.unlock();
+	}
+
+	uint64_t GetHits() { return m_Hits; }
+	uint64_t GetMisses() { return m_Misses; }
+	uint64_t GetInUse() { return m_InUse; }
+	uint64_t GetHighWater() { return m_HighWater; }
+	uint64_t GetShrunk() { return m_Shrunk; }
+
+private:
+	BufferPool() = default;
+
+	struct FreeList
+	{
+		std::mutex m_Mutex;
+		std::vector<PooledBuffer*> m_Buffers;
+	};
+
+	FreeList m_FreeLists[(size_t)BufferClass::MAX_SIZE];
+	std::atomic<uint64_t> m_Hits{};
+	std::atomic<uint64_t> m_Misses{};
+	std::atomic<uint64_t> m_InUse{};
+	std::atomic<uint64_t> m_HighWater{};
+	std::atomic<uint64_t> m_Shrunk{};	// Buffers reallocated on release because they outgrew their class
+};
+
+inline void BufferRef::reset()
+{
+	if (m_Buffer && m_Buffer->m_References.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		BufferPool::Get().Release(m_Buffer);
+	}
+	m_Buffer = nullptr;
+}
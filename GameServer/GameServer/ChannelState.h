@@ -0,0 +1,205 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include "NetworkMessageReader.h"
+
+const uint16_t ORDERED_WINDOW = 64;	// Max amount of messages held back per ordered stream while waiting for an earlier one
+
+// Whether a received message is acknowledged and handled
+enum class Admission
+{
+	Accept,		// Acknowledge and handle
+	Duplicate,	// Acknowledge but do not handle, it was handled already or got superseded
+	Refuse		// Neither, it is too far ahead of its ordered stream and has to be resent later
+};
+
+// Per connection channel sequences of both directions. Outgoing sequenced and ordered messages are numbered
+// per stream starting at 1, incoming ones are dropped when stale or held back until they are next in order.
+// Channel sequence 0 marks a message sent without sequencing, it is always handled right away
+class ChannelState
+{
+public:
+	ChannelState()
+	{
+		for (OrderedStream& stream : m_Ordered)
+		{
+			stream.m_Pending.resize(ORDERED_WINDOW);
+		}
+	}
+
+	uint16_t NextSequence(Stream stream)
+	{
+		uint16_t sequence = ++m_NextSequence[(size_t)stream];
+		if (sequence == 0)
+		{
+			sequence = ++m_NextSequence[(size_t)stream];
+		}
+		return sequence;
+	}
+
+	// Decide before acknowledging a message of the given type, for fragments the type of the whole message
+	Admission Admit(PacketType type, uint16_t channel_sequence)
+	{
+		ChannelInfo channel = GetChannel(type);
+		if (channel_sequence == 0 || !channel.IsSequenced())
+		{
+			return Admission::Accept;
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (channel.m_Channel == Channel::UnreliableSequenced)
+		{
+			uint16_t latest = m_Latest[(size_t)channel.m_Stream];
+			return latest == 0 || IsSequenceNewer(channel_sequence, latest) ? Admission::Accept : Admission::Duplicate;
+		}
+
+		OrderedStream& stream = m_Ordered[(size_t)channel.m_Stream];
+		uint16_t distance = Distance(stream.m_Expected, channel_sequence);
+		if (IsSequenceNewer(stream.m_Expected, channel_sequence))
+		{
+			return Admission::Duplicate;
+		}
+
+		return distance < ORDERED_WINDOW ? Admission::Accept : Admission::Refuse;
+	}
+
+	// Messages Deliver hands out for an admitted message: the message itself and the held back messages it releases,
+	// none while it has to wait for an earlier one. Exact because a connection is only ever fed from one receive thread
+	size_t CountDeliveries(PacketType type, uint16_t channel_sequence)
+	{
+		ChannelInfo channel = GetChannel(type);
+		if (channel_sequence == 0 || channel.m_Channel != Channel::ReliableOrdered)
+		{
+			return 1;
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		OrderedStream& stream = m_Ordered[(size_t)channel.m_Stream];
+		if (channel_sequence != stream.m_Expected)
+		{
+			return 0;
+		}
+
+		size_t count = 1;
+		uint16_t sequence = NextSequenceId(channel_sequence);
+		while (count < ORDERED_WINDOW)
+		{
+			const PendingMessage& pending = stream.m_Pending[sequence % ORDERED_WINDOW];
+			if (!pending.m_Present || pending.m_Sequence != sequence)
+			{
+				break;
+			}
+
+			count++;
+			sequence = NextSequenceId(sequence);
+		}
+		return count;
+	}
+
+	// Hand an admitted message to handle(reader), sequenced messages that got superseded in the meantime are dropped
+	// and ordered ones are held back until every message before them in their stream has been handled.
+	// handle returns false to stop handing out messages held back, e.g. once the connection is gone
+	template<typename Func>
+	void Deliver(NetworkMessageReader& msg, Func handle)
+	{
+		ChannelInfo channel = GetChannel(msg.GetType());
+		uint16_t channel_sequence = msg.GetChannelSequence();
+		if (channel_sequence == 0 || !channel.IsSequenced())
+		{
+			handle(msg);
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		if (channel.m_Channel == Channel::UnreliableSequenced)
+		{
+			uint16_t& latest = m_Latest[(size_t)channel.m_Stream];
+			if (latest == 0 || IsSequenceNewer(channel_sequence, latest))
+			{
+				latest = channel_sequence;
+				lock.unlock();
+				handle(msg);
+			}
+			return;
+		}
+
+		OrderedStream& stream = m_Ordered[(size_t)channel.m_Stream];
+		uint16_t distance = Distance(stream.m_Expected, channel_sequence);
+		if (IsSequenceNewer(stream.m_Expected, channel_sequence) || distance >= ORDERED_WINDOW)
+		{
+			return;
+		}
+
+		if (distance > 0)
+		{
+			// Copy it out of the receive buffer until its turn comes
+			PendingMessage& pending = stream.m_Pending[channel_sequence % ORDERED_WINDOW];
+			if (!pending.m_Present || pending.m_Sequence != channel_sequence)
+			{
+				const uint8_t* data = msg.GetData();
+				pending.m_Data.assign(data, data + msg.GetSize());
+				pending.m_Sequence = channel_sequence;
+				pending.m_Present = true;
+			}
+			return;
+		}
+
+		// Handlers run without the lock held, the stream is only ever fed from one receive thread
+		stream.m_Expected = NextSequenceId(stream.m_Expected);
+		lock.unlock();
+		if (!handle(msg))
+		{
+			return;
+		}
+
+		lock.lock();
+		while (true)
+		{
+			PendingMessage& pending = stream.m_Pending[stream.m_Expected % ORDERED_WINDOW];
+			if (!pending.m_Present || pending.m_Sequence != stream.m_Expected)
+			{
+				break;
+			}
+
+			pending.m_Present = false;
+			stream.m_Expected = NextSequenceId(stream.m_Expected);
+
+			m_Released.swap(pending.m_Data);
+			lock.unlock();
+			NetworkMessageReader released(m_Released.data(), m_Released.size(), msg.GetEndpoint());
+			if (!handle(released))
+			{
+				return;
+			}
+			lock.lock();
+		}
+	}
+
+private:
+	struct PendingMessage
+	{
+		bool m_Present = false;
+		uint16_t m_Sequence = 0;
+		std::vector<uint8_t> m_Data;
+	};
+
+	struct OrderedStream
+	{
+		uint16_t m_Expected = 1;
+		std::vector<PendingMessage> m_Pending;
+	};
+
+	// Steps from expected to sequence skipping 0, which is never used for sequenced messages
+	static uint16_t Distance(uint16_t expected, uint16_t sequence)
+	{
+		uint16_t distance = sequence - expected;
+		return sequence < expected ? distance - 1 : distance;
+	}
+
+	std::mutex m_Mutex;
+	std::atomic<uint16_t> m_NextSequence[(size_t)Stream::MAX_SIZE]{};
+	uint16_t m_Latest[(size_t)Stream::MAX_SIZE]{};
+	OrderedStream m_Ordered[(size_t)Stream::MAX_SIZE];
+	std::vector<uint8_t> m_Released;
+};
@@ -0,0 +1,126 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include "RetransmitScheduler.h"
+
+const uint32_t CONGESTION_MIN_RATE = 8 * 1024;		// Bytes per second a connection is always allowed to send
+const uint32_t CONGESTION_INCREASE = 16 * 1024;		// Bytes per second added after an interval in which the budget ran out without congestion
+const float CONGESTION_DECREASE = 0.7f;				// Rate is multiplied by this after an interval with congestion
+const float CONGESTION_MAX_LOSS = 0.05f;			// Share of messages lost in an interval above which it counts as congested
+const std::chrono::milliseconds CONGESTION_MAX_QUEUE_DELAY(100);	// Roundtrip time above the lowest one seen that counts as congested
+const std::chrono::milliseconds CONGESTION_MIN_INTERVAL(100);		// Rate is adjusted at most once per interval, or once per roundtrip if longer
+const std::chrono::milliseconds CONGESTION_BURST(50);				// Sending time at the current rate the budget can save up
+const double CONGESTION_MIN_BURST = 2 * 1200;		// Budget that can always be saved up, two full datagrams
+
+// Token bucket limiting the bytes per second sent to a connection. The rate follows AIMD: it grows by a fixed step
+// after every interval in which the budget ran out while messages got through, and is cut after an interval in which
+// too many messages got lost or the roundtrip time grew by more than CONGESTION_MAX_QUEUE_DELAY.
+// Not thread safe, owned by a connection's ReliableWindow and only used under its lock
+class CongestionController
+{
+public:
+	using Clock = RetransmitScheduler::Clock;
+
+	CongestionController(uint32_t initial_rate, uint32_t max_rate)
+		: m_Rate(std::max(initial_rate, CONGESTION_MIN_RATE)), m_MaxRate(std::max(max_rate, CONGESTION_MIN_RATE))
+	{
+		m_Tokens = GetBurstSize();
+		m_LastRefill = m_IntervalStart = Clock::now();
+	}
+
+	uint32_t GetRate() { return m_Rate; }
+
+	// Take bytes from the budget, returns false if sending them now would exceed it
+	bool TryConsume(size_t bytes, Clock::time_point now)
+	{
+		Update(now);
+
+		if (m_Tokens < (double)bytes)
+		{
+			m_Limited = true;
+			return false;
+		}
+
+		m_Tokens -= (double)bytes;
+		return true;
+	}
+
+	// Time at which bytes fit the budget after everything reserved before, spreads out messages waiting for budget
+	Clock::time_point Reserve(size_t bytes, Clock::time_point now)
+	{
+		m_Reserved = std::max(m_Reserved, now) + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((double)bytes / m_Rate));
+		return m_Reserved;
+	}
+
+	void OnAcked() { m_Acked++; }
+	void OnLost() { m_Lost++; }
+	// A message reported lost was acknowledged after all, only undone while its interval is still running
+	void OnSpuriousLoss() { m_Lost -= m_Lost > 0 ? 1 : 0; }
+
+	void OnRoundtrip(Clock::duration roundtrip_time)
+	{
+		m_RoundtripTime = m_RoundtripTime == Clock::duration::zero() ? roundtrip_time : (7 * m_RoundtripTime + roundtrip_time) / 8;
+		if (!m_HasMinRoundtrip || roundtrip_time < m_MinRoundtripTime)
+		{
+			m_MinRoundtripTime = roundtrip_time;
+			m_HasMinRoundtrip = true;
+		}
+
+		// Queues along the path are filling up, react before they start dropping
+		if (roundtrip_time > m_MinRoundtripTime + CONGESTION_MAX_QUEUE_DELAY)
+		{
+			m_Delayed = true;
+		}
+	}
+
+private:
+	void Update(Clock::time_point now)
+	{
+		double elapsed = std::chrono::duration<double>(now - m_LastRefill).count();
+		m_Tokens = std::min(GetBurstSize(), m_Tokens + elapsed * m_Rate);
+		m_LastRefill = now;
+
+		// Decisions are made once per roundtrip so a decrease can take effect before it is judged again
+		if (now - m_IntervalStart < std::max<Clock::duration>(CONGESTION_MIN_INTERVAL, m_RoundtripTime))
+		{
+			return;
+		}
+
+		uint32_t sent = m_Acked + m_Lost;
+		if (m_Delayed || (sent > 0 && (float)m_Lost / sent > CONGESTION_MAX_LOSS))
+		{
+			m_Rate = std::max(CONGESTION_MIN_RATE, (uint32_t)(m_Rate * CONGESTION_DECREASE));
+			m_Tokens = std::min(m_Tokens, GetBurstSize());
+		}
+		else if (m_Limited && m_Acked > 0)
+		{
+			// A connection that does not use its budget, or hears nothing back, keeps its rate
+			m_Rate = std::min(m_MaxRate, m_Rate + CONGESTION_INCREASE);
+		}
+
+		m_Acked = 0;
+		m_Lost = 0;
+		m_Limited = false;
+		m_Delayed = false;
+		m_IntervalStart = now;
+	}
+
+	double GetBurstSize()
+	{
+		return std::max(CONGESTION_MIN_BURST, m_Rate * std::chrono::duration<double>(CONGESTION_BURST).count());
+	}
+
+	uint32_t m_Rate;
+	uint32_t m_MaxRate;
+	double m_Tokens = 0.0;
+	Clock::time_point m_LastRefill;
+	Clock::time_point m_IntervalStart;
+	Clock::time_point m_Reserved;
+	Clock::duration m_RoundtripTime{};
+	Clock::duration m_MinRoundtripTime{};
+	bool m_HasMinRoundtrip = false;
+	uint32_t m_Acked = 0;
+	uint32_t m_Lost = 0;
+	bool m_Limited = false;
+	bool m_Delayed = false;
+};
@@ -0,0 +1,146 @@
+#pragma once
+#include <random>
+#include <cstdint>
+#include "RetransmitScheduler.h"
+#include "ECS/Components/Connection.h"
+
+// HandShake payload of an endpoint without a connection: issue time (uint32), MAC (uint64).
+// A first HandShake carries an issue time of 0 and is padded to the same size so the Challenge it gets back is no larger
+const size_t COOKIE_SIZE = 12;
+const std::chrono::seconds COOKIE_LIFETIME(10);	// A Challenge has to be answered within this long
+
+// Stateless challenge for new endpoints, nothing is stored until a HandShake echoes a cookie issued to its endpoint.
+// The MAC is SipHash-2-4 over the endpoint and issue time under a key drawn at startup, so spoofed sources that
+// never see the Challenge can not produce one. Thread safe, the key is never written after construction
+class ConnectCookie
+{
+public:
+	using Clock = RetransmitScheduler::Clock;
+
+	ConnectCookie() : m_Epoch(Clock::now())
+	{
+		std::random_device device;
+		m_Key[0] = (uint64_t)device() << 32 | device();
+		m_Key[1] = (uint64_t)device() << 32 | device();
+	}
+
+	// Write a cookie for the endpoint into cookie (COOKIE_SIZE bytes)
+	void Issue(const asio::ip::udp::endpoint& endpoint, Clock::time_point now, uint8_t* cookie)
+	{
+		uint32_t issued = GetTime(now);
+		uint64_t mac = Sign(endpoint, issued);
+		for (size_t i = 0; i < sizeof(uint32_t); ++i)
+		{
+			cookie[i] = (uint8_t)(issued >> 8 * i);
+		}
+		for (size_t i = 0; i < sizeof(uint64_t); ++i)
+		{
+			cookie[4 + i] = (uint8_t)(mac >> 8 * i);
+		}
+	}
+
+	// True if cookie was issued to the endpoint no longer than COOKIE_LIFETIME ago
+	bool Verify(const asio::ip::udp::endpoint& endpoint, const uint8_t* cookie, Clock::time_point now)
+	{
+		uint32_t issued = 0;
+		uint64_t mac = 0;
+		for (size_t i = 0; i < sizeof(uint32_t); ++i)
+		{
+			issued |= (uint32_t)cookie[i] << 8 * i;
+		}
+		for (size_t i = 0; i < sizeof(uint64_t); ++i)
+		{
+			mac |= (uint64_t)cookie[4 + i] << 8 * i;
+		}
+
+		uint32_t time = GetTime(now);
+		return issued != 0 && issued <= time && time - issued <= (uint32_t)COOKIE_LIFETIME.count() && mac == Sign(endpoint, issued);
+	}
+
+	// Issue time 0 marks a HandShake that does not carry a cookie yet
+	static bool IsEmpty(const uint8_t* cookie)
+	{
+		return (cookie[0] | cookie[1] | cookie[2] | cookie[3]) == 0;
+	}
+
+private:
+	// Seconds since startup, starting at 1
+	uint32_t GetTime(Clock::time_point now)
+	{
+		return (uint32_t)std::chrono::duration_cast<std::chrono::seconds>(now - m_Epoch).count() + 1;
+	}
+
+	uint64_t Sign(const asio::ip::udp::endpoint& endpoint, uint32_t issued)
+	{
+		// Address (v6 or v4 mapped to v6), port and issue time
+		uint8_t data[16 + 2 + 4];
+		asio::ip::address_v6::bytes_type address = endpoint.address().is_v4()
+			? asio::ip::make_address_v6(asio::ip::v4_mapped, endpoint.address().to_v4()).to_bytes()
+			: endpoint.address().to_v6().to_bytes();
+		std::copy(address.begin(), address.end(), data);
+		data[16] = (uint8_t)endpoint.port();
+		data[17] = (uint8_t)(endpoint.port() >> 8);
+		for (size_t i = 0; i < sizeof(uint32_t); ++i)
+		{
+			data[18 + i] = (uint8_t)(issued >> 8 * i);
+		}
+
+		return SipHash(data, sizeof(data));
+	}
+
+	static uint64_t Rotate(uint64_t value, int bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	static void Round(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3)
+	{
+		v0 += v1; v1 = Rotate(v1, 13); v1 ^= v0; v0 = Rotate(v0, 32);
+		v2 += v3; v3 = Rotate(v3, 16); v3 ^= v2;
+		v0 += v3; v3 = Rotate(v3, 21); v3 ^= v0;
+		v2 += v1; v1 = Rotate(v1, 17); v1 ^= v2; v2 = Rotate(v2, 32);
+	}
+
+	uint64_t SipHash(const uint8_t* data, size_t size)
+	{
+		uint64_t v0 = 0x736f6d6570736575ULL ^ m_Key[0];
+		uint64_t v1 = 0x646f72616e646f6dULL ^ m_Key[1];
+		uint64_t v2 = 0x6c7967656e657261ULL ^ m_Key[0];
+		uint64_t v3 = 0x7465646279746573ULL ^ m_Key[1];
+
+		// Little-endian 8 byte words, the last one padded with zeros and the length in its top byte
+		for (size_t offset = 0; offset <= size; offset += 8)
+		{
+			uint64_t word = 0;
+			size_t count = std::min<size_t>(8, size - std::min(offset, size));
+			for (size_t i = 0; i < count; ++i)
+			{
+				word |= (uint64_t)data[offset + i] << 8 * i;
+			}
+			if (count < 8)
+			{
+				word |= (uint64_t)size << 56;
+			}
+
+			v3 ^= word;
+			Round(v0, v1, v2, v3);
+			Round(v0, v1, v2, v3);
+			v0 ^= word;
+
+			if (count < 8)
+			{
+				break;
+			}
+		}
+
+		v2 ^= 0xff;
+		for (int i = 0; i < 4; ++i)
+		{
+			Round(v0, v1, v2, v3);
+		}
+		return v0 ^ v1 ^ v2 ^ v3;
+	}
+
+	Clock::time_point m_Epoch;
+	uint64_t m_Key[2];
+};
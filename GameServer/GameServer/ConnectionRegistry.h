@@ -0,0 +1,80 @@
+#pragma once
+#include <shared_mutex>
+#include <unordered_map>
+#include "ECS/EntityManager.h"
+#include "ECS/Components/Connection.h"
+
+// Maps remote endpoints to their connection entity, kept in sync by Network on connect and disconnect.
+// Each entry holds a copy of the Connection component taken on connect, it shares the transport state with the
+// component so the receive threads can reach it without touching the ECS. Fields the simulation changes later,
+// like m_Authorized, are only valid in the component
+class ConnectionRegistry
+{
+public:
+	struct Entry
+	{
+		Entity m_Entity = -1;
+		std::shared_ptr<const Connection> m_Connection;
+	};
+
+	void Add(const asio::ip::udp::endpoint& endpoint, Entity entity, const Connection& connection)
+	{
+		std::unique_lock<std::shared_mutex> lock(m_Mutex);
+		assert(m_Entities.find(endpoint) == m_Entities.end() && "Endpoint registered more than once.");
+
+		m_Entities.emplace(endpoint, Entry{ entity, std::make_shared<const Connection>(connection) });
+	}
+
+	void Remove(const asio::ip::udp::endpoint& endpoint)
+	{
+		std::unique_lock<std::shared_mutex> lock(m_Mutex);
+		m_Entities.erase(endpoint);
+	}
+
+	// Returns the entity owning the endpoint or -1 if there is none
+	Entity Find(const asio::ip::udp::endpoint& endpoint)
+	{
+		std::shared_lock<std::shared_mutex> lock(m_Mutex);
+		std::unordered_map<asio::ip::udp::endpoint, Entry, EndpointHash>::const_iterator itr = m_Entities.find(endpoint);
+		if (itr != m_Entities.end())
+		{
+			return itr->second.m_Entity;
+		}
+
+		return -1;
+	}
+
+	// Returns the entry of the endpoint, without a connection if there is none
+	Entry Get(const asio::ip::udp::endpoint& endpoint)
+	{
+		std::shared_lock<std::shared_mutex> lock(m_Mutex);
+		std::unordered_map<asio::ip::udp::endpoint, Entry, EndpointHash>::const_iterator itr = m_Entities.find(endpoint);
+		if (itr != m_Entities.end())
+		{
+			return itr->second;
+		}
+
+		return Entry{};
+	}
+
+	size_t Size()
+	{
+		std::shared_lock<std::shared_mutex> lock(m_Mutex);
+		return m_Entities.size();
+	}
+
+	// Calls func(entity, connection) for every registered connection, the registry must not be modified from within
+	template<typename Func>
+	void ForEach(Func func)
+	{
+		std::shared_lock<std::shared_mutex> lock(m_Mutex);
+		for (const std::pair<const asio::ip::udp::endpoint, Entry>& pair : m_Entities)
+		{
+			func(pair.second.m_Entity, *pair.second.m_Connection);
+		}
+	}
+
+private:
+	std::shared_mutex m_Mutex;
+	std::unordered_map<asio::ip::udp::endpoint, Entry, EndpointHash> m_Entities;
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+const size_t HISTOGRAM_BUCKET_COUNT = 12;
+const uint64_t HISTOGRAM_BUCKET_BOUNDS[HISTOGRAM_BUCKET_COUNT - 1] = { 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000 };	// Microseconds, the last bucket takes anything longer
+
+// Counts durations into fixed buckets. Recorded by one thread, read by any
+class DurationHistogram
+{
+public:
+	void Record(std::chrono::steady_clock::duration duration)
+	{
+		uint64_t microseconds = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+		size_t bucket = 0;
+		while (bucket < HISTOGRAM_BUCKET_COUNT - 1 && microseconds > HISTOGRAM_BUCKET_BOUNDS[bucket])
+		{
+			bucket++;
+		}
+
+		m_Buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+		m_Count.fetch_add(1, std::memory_order_relaxed);
+		m_Total.fetch_add(microseconds, std::memory_order_relaxed);
+		if (microseconds > m_Max.load(std::memory_order_relaxed))
+		{
+			m_Max.store(microseconds, std::memory_order_relaxed);
+		}
+	}
+
+	uint64_t GetCount() { return m_Count; }
+	uint64_t GetMax() { return m_Max; }
+	double GetAverage() { return m_Count > 0 ? (double)m_Total / m_Count : 0.0; }
+
+	// Samples longer than a bucket bound
+	uint64_t GetCountOver(uint64_t microseconds)
+	{
+		uint64_t count = 0;
+		for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i)
+		{
+			if (i > 0 && HISTOGRAM_BUCKET_BOUNDS[i - 1] >= microseconds)
+			{
+				count += m_Buckets[i];
+			}
+		}
+		return count;
+	}
+
+	// Upper bound of the bucket holding the given fraction of the samples, the max for the last bucket
+	uint64_t GetPercentile(double fraction)
+	{
+		uint64_t target = (uint64_t)(fraction * m_Count);
+		uint64_t count = 0;
+		for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT - 1; ++i)
+		{
+			count += m_Buckets[i];
+			if (count > 0 && count >= target)
+			{
+				return HISTOGRAM_BUCKET_BOUNDS[i];
+			}
+		}
+		return m_Max;
+	}
+
+	// Bucket counts as "<= 50 us: n | ... | > 100000 us: n"
+	void Print(std::ostream& out)
+	{
+		for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT - 1; ++i)
+		{
+			out << "<= " << HISTOGRAM_BUCKET_BOUNDS[i] << " us: " << m_Buckets[i] << " | ";
+		}
+		out << "> " << HISTOGRAM_BUCKET_BOUNDS[HISTOGRAM_BUCKET_COUNT - 2] << " us: " << m_Buckets[HISTOGRAM_BUCKET_COUNT - 1];
+	}
+
+private:
+	std::atomic<uint64_t> m_Buckets[HISTOGRAM_BUCKET_COUNT]{};
+	std::atomic<uint64_t> m_Count{};
+	std::atomic<uint64_t> m_Total{};	// Microseconds
+	std::atomic<uint64_t> m_Max{};		// Microseconds
+};
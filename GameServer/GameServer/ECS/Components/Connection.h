@@ -5,12 +5,49 @@
 #endif
 #define ASIO_STANDALONE
 #include <asio.hpp>
+#include <memory>
 
+// Hash for using endpoints as keys in unordered containers
+struct EndpointHash
+{
+	size_t operator()(const asio::ip::udp::endpoint& endpoint) const
+	{
+		uint64_t hash = endpoint.port();
+		const asio::ip::address& address = endpoint.address();
+		if (address.is_v4())
+		{
+			hash |= (uint64_t)address.to_v4().to_uint() << 16;
+		}
+		else
+		{
+			for (uint8_t byte : address.to_v6().to_bytes())
+			{
+				hash = (hash << 5) + hash + byte;
+			}
+		}
+
+		// Mix the bits so consecutive ports and addresses spread over buckets
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 33;
+		return (size_t)hash;
+	}
+};
+
+class ReliableWindow;
+class MessageBundle;
+class FragmentAssembler;
+class ChannelState;
+class IngressLimiter;
 struct Connection
 {
 	uint32_t m_Id;
 	asio::ip::udp::endpoint m_Endpoint;
 	bool m_Authorized = false;
-	uint64_t m_RoundtripTime = 255;
 	float m_PingTimer;
+	std::shared_ptr<ReliableWindow> m_Reliability;
+	std::shared_ptr<MessageBundle> m_Bundle;
+	std::shared_ptr<FragmentAssembler> m_Fragments;
+	std::shared_ptr<ChannelState> m_Channels;
+	std::shared_ptr<IngressLimiter> m_Ingress;
 };
\ No newline at end of file
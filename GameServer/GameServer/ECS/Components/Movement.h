@@ -1,6 +1,9 @@
 #pragma once
 #include "../GameServer/VectorMath.h"
 
+const float MAX_MOVEMENT_SPEED = 16.f;		// Speeds are quantized to [0, MAX_MOVEMENT_SPEED] on the wire
+const float MOVEMENT_SPEED_PRECISION = 1.f / 16.f;
+
 struct Movement
 {
 	Vector2 m_Direction;
@@ -36,6 +36,14 @@ private:
 	std::vector<std::vector<T> > m_Data;
 };
 
+const int WORLD_MAX_SIZE = 1000;		// Max width and height of a world in tiles
+const float WORLD_TILE_SIZE = 100.f;	// Position units per tile
+
+// Bounds and precision positions are quantized to on the wire
+const Vector3 WORLD_MIN_POSITION = { 0.f, -512.f, 0.f };
+const Vector3 WORLD_MAX_POSITION = { WORLD_MAX_SIZE * WORLD_TILE_SIZE, 512.f, WORLD_MAX_SIZE * WORLD_TILE_SIZE };
+const float WORLD_POSITION_PRECISION = 0.5f;
+
 struct Tile
 {
 	enum class Type
@@ -4,6 +4,7 @@
 #include <cassert>
 #include <array>
 #include <unordered_map>
+#include <vector>
 #include <memory>
 #include "Systems/IEntitySystem.h"
 
@@ -157,6 +158,7 @@ public:
 
 		std::shared_ptr<T> system = std::make_shared<T>();
 		m_Systems.insert({ hash, system });
+		m_UpdateOrder.push_back(system);
 		return system;
 	}
 
@@ -174,7 +176,10 @@ public:
 		for (const std::pair<size_t, std::shared_ptr<IEntitySystem>>& pair : m_Systems)
 		{
 			const std::shared_ptr<IEntitySystem>& system = pair.second;
-			system->m_Entities.erase(entity);
+			if (system->m_Entities.erase(entity) > 0)
+			{
+				system->EntityRemoved(entity);
+			}
 		}
 	}
 
@@ -188,11 +193,14 @@ public:
 
 			if ((signature & systemSignature) == systemSignature)
 			{
-				system->m_Entities.insert(entity);
+				if (system->m_Entities.insert(entity).second)
+				{
+					system->EntityAdded(entity);
+				}
 			}
-			else
+			else if (system->m_Entities.erase(entity) > 0)
 			{
-				system->m_Entities.erase(entity);
+				system->EntityRemoved(entity);
 			}
 		}
 	}
@@ -206,19 +214,16 @@ public:
 		return std::static_pointer_cast<T>(m_Systems[hash]);
 	}
 
-	std::vector<std::shared_ptr<IEntitySystem>> GetSystems()
+	// Systems in the order they were registered, which is the order they are updated in
+	const std::vector<std::shared_ptr<IEntitySystem>>& GetSystems()
 	{
-		std::vector<std::shared_ptr<IEntitySystem>> systems;
-		for (const auto& system : m_Systems)
-		{
-			systems.push_back(system.second);
-		}
-		return systems;
+		return m_UpdateOrder;
 	}
 
 private:
 	std::unordered_map<size_t, Signature> m_Signatures{};
 	std::unordered_map<size_t, std::shared_ptr<IEntitySystem>> m_Systems{};
+	std::vector<std::shared_ptr<IEntitySystem>> m_UpdateOrder{};
 };
 
 class EntityManager
@@ -332,7 +337,7 @@ public:
 		return m_SystemManager->GetSystem<T>();
 	}
 
-	std::vector<std::shared_ptr<IEntitySystem>> GetSystems()
+	const std::vector<std::shared_ptr<IEntitySystem>>& GetSystems()
 	{
 		return m_SystemManager->GetSystems();
 	}
@@ -347,20 +352,6 @@ public:
 		return entities;
 	}
 
-	Entity GetEntityFromEndpoint(const asio::ip::udp::endpoint& remote_endpoint)
-	{
-		for (Entity entity = 0; entity < m_ActiveEntities; ++entity)
-		{
-			const Connection& client = GetComponent<Connection>(entity);
-			if (client.m_Endpoint == remote_endpoint)
-			{
-				return entity;
-			}
-		}
-
-		return -1;
-	}
-
 private:
 	std::queue<Entity> m_EntityPool{};
 	std::array<std::bitset<MAX_COMPONENTS>, MAX_ENTITIES> m_Signatures{};
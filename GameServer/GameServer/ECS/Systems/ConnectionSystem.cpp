@@ -3,9 +3,33 @@
 
 void ConnectionSystem::Update(Game* game, float dt)
 {
+	DropBroken(game);
 	Ping(game, dt);
 }
 
+// A connection that lost a reliable message has ordered streams waiting for it forever, it is closed rather than
+// left looking alive
+void ConnectionSystem::DropBroken(Game* game)
+{
+	EntityManager* ecs = game->GetECS();
+
+	m_Broken.clear();
+	for (const Entity& entity : m_Entities)
+	{
+		if (ecs->GetComponent<Connection>(entity).m_Reliability->HasLostReliable())
+		{
+			m_Broken.push_back(entity);
+		}
+	}
+
+	for (Entity entity : m_Broken)
+	{
+		Connection& client = ecs->GetComponent<Connection>(entity);
+		std::cout << "Reliable message lost | " << client.m_Endpoint << " | id: " << client.m_Id << std::endl;
+		game->GetNetwork()->TerminateClient(client);
+	}
+}
+
 void ConnectionSystem::Ping(Game* game, float dt)
 {
 	EntityManager* ecs = game->GetECS();
@@ -19,9 +43,10 @@ void ConnectionSystem::Ping(Game* game, float dt)
 			client.m_PingTimer -= dt;
 			if (client.m_PingTimer <= 0)
 			{
-				NetworkMessage msg(PacketType::Ping, client.m_Endpoint);
-				msg.Write(client.m_RoundtripTime);
-				msg.Write(game->GetElapsedTime());
+				ServerPing packet;
+				packet.m_Roundtrip = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(client.m_Reliability->GetRoundtripTime()).count();
+				packet.m_Timestamp = RoundtripEstimator::ToTimestamp(RetransmitScheduler::Clock::now());
+				NetworkMessage msg = MakeMessage(packet, client.m_Endpoint);
 				game->GetNetwork()->Send(msg);
 
 				client.m_PingTimer = m_PingInterval;
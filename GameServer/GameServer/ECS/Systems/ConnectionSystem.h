@@ -1,4 +1,5 @@
 #pragma once
+#include <vector>
 #include "IEntitySystem.h"
 
 class ConnectionSystem : public IEntitySystem
@@ -8,6 +9,8 @@ public:
 
 private:
 	void Ping(Game* game, float dt);
+	void DropBroken(Game* game);
 	uint64_t m_PingInterval = 3;
+	std::vector<Entity> m_Broken;
 };
 
@@ -9,4 +9,9 @@ class IEntitySystem
 public:
 	std::set<Entity> m_Entities;
 	virtual void Update(Game* game, float dt) = 0;
+
+	// Called once an entity starts matching the signature of the system
+	virtual void EntityAdded(Entity /*entity*/) {}
+	// Called once an entity is destroyed or no longer matches the signature of the system
+	virtual void EntityRemoved(Entity /*entity*/) {}
 };
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include "InterestSystem.h"
+#include "../GameServer/Game.h"
+
+void InterestSystem::Update(Game* game, float /*dt*/)
+{
+	uint32_t tick = (uint32_t)game->GetElapsedTime() + 1;
+	float view_radius = game->GetNetwork()->GetSettings().m_ViewRadius;
+	EntityManager* ecs = game->GetECS();
+
+	// Authorized players first, so the lookups of the players in view below are a single find
+	for (const Entity& entity : m_Entities)
+	{
+		const Connection& client = ecs->GetComponent<Connection>(entity);
+		if (client.m_Authorized)
+		{
+			ClientInterest& interest = m_Clients[entity];
+			if (interest.m_ClientId != client.m_Id)
+			{
+				// The entity was reused by someone else since the last tick
+				interest.m_ClientId = client.m_Id;
+				interest.m_Visible.clear();
+			}
+			interest.m_Tick = tick;
+		}
+	}
+
+	m_TickVisiblePairs = 0;
+	for (std::pair<const Entity, ClientInterest>& pair : m_Clients)
+	{
+		if (pair.second.m_Tick == tick)
+		{
+			UpdateClient(game, pair.first, pair.second, tick, view_radius);
+		}
+	}
+
+	// Forget clients that disconnected or are no longer authorized
+	for (std::unordered_map<Entity, ClientInterest>::iterator itr = m_Clients.begin(); itr != m_Clients.end();)
+	{
+		if (itr->second.m_Tick != tick)
+		{
+			itr = m_Clients.erase(itr);
+		}
+		else
+		{
+			++itr;
+		}
+	}
+
+	m_ClientCount = m_Clients.size();
+	m_VisiblePairs = m_TickVisiblePairs;
+}
+
+const std::vector<VisibleEntity>* InterestSystem::GetVisible(Entity client)
+{
+	std::unordered_map<Entity, ClientInterest>::const_iterator itr = m_Clients.find(client);
+	if (itr != m_Clients.end())
+	{
+		return &itr->second.m_Visible;
+	}
+
+	return nullptr;
+}
+
+void InterestSystem::PrintStats()
+{
+	uint64_t clients = m_ClientCount;
+	std::cout << "[Interest] Clients: " << clients << " | Avg visible: " << (clients > 0 ? (double)m_VisiblePairs / clients : 0.0);
+	std::cout << " | Entered: " << m_Entered << " | Left: " << m_Left << std::endl;
+}
+
+void InterestSystem::UpdateClient(Game* game, Entity entity, ClientInterest& interest, uint32_t tick, float view_radius)
+{
+	EntityManager* ecs = game->GetECS();
+	Network* network = game->GetNetwork();
+	const Connection& client = ecs->GetComponent<Connection>(entity);
+	Vector2 center = SpatialSystem::ToGridPosition(ecs->GetComponent<Transform>(entity));
+
+	// Only players are replicated for now, anything else the spatial index knows about is skipped
+	m_Scratch.clear();
+	for (Entity other : ecs->GetSystem<SpatialSystem>()->QueryRadius(center, view_radius))
+	{
+		std::unordered_map<Entity, ClientInterest>::const_iterator itr = m_Clients.find(other);
+		if (itr != m_Clients.end() && itr->second.m_Tick == tick)
+		{
+			m_Scratch.push_back(VisibleEntity{ itr->second.m_ClientId, other, tick });
+		}
+	}
+	std::sort(m_Scratch.begin(), m_Scratch.end(), [](const VisibleEntity& lhs, const VisibleEntity& rhs)
+	{
+		return lhs.m_Id < rhs.m_Id;
+	});
+
+	// Diff against what the client had in view last tick
+	std::vector<VisibleEntity>& previous = interest.m_Visible;
+	size_t i = 0, j = 0;
+	while (i < m_Scratch.size() || j < previous.size())
+	{
+		if (j == previous.size() || (i < m_Scratch.size() && m_Scratch[i].m_Id < previous[j].m_Id))
+		{
+			const Transform& transform = ecs->GetComponent<Transform>(m_Scratch[i].m_Entity);
+			NetworkMessage msg = MakeMessage(ServerPlayerData{ m_Scratch[i].m_Id, transform.m_Position }, client.m_Endpoint);
+			network->Send(msg);
+
+			m_Entered++;
+			++i;
+		}
+		else if (i == m_Scratch.size() || previous[j].m_Id < m_Scratch[i].m_Id)
+		{
+			NetworkMessage msg = MakeMessage(ServerRemoveCreature{ previous[j].m_Id }, client.m_Endpoint);
+			network->Send(msg);
+
+			m_Left++;
+			++j;
+		}
+		else
+		{
+			// Still in view, keep the tick it entered
+			m_Scratch[i++].m_Since = previous[j++].m_Since;
+		}
+	}
+
+	previous.swap(m_Scratch);
+	m_TickVisiblePairs += previous.size();
+}
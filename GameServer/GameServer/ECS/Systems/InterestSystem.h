@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+#include "IEntitySystem.h"
+
+// An entity a client currently has in view
+struct VisibleEntity
+{
+	uint32_t m_Id;
+	Entity m_Entity;
+	uint32_t m_Since;	// Tick it came into view
+};
+
+// Area of interest: every client only has the players within the view radius replicated to it, found through
+// the SpatialSystem. Entering and leaving the view sends PlayerData and RemoveCreature to the client
+class InterestSystem : public IEntitySystem
+{
+public:
+	void Update(Game* game, float dt) override;
+
+	// Players in view of a client sorted by id, nullptr if the client is not tracked (yet)
+	const std::vector<VisibleEntity>* GetVisible(Entity client);
+	void PrintStats();
+
+private:
+	struct ClientInterest
+	{
+		uint32_t m_ClientId = 0;
+		uint32_t m_Tick = 0;	// Last tick the client was authorized
+		std::vector<VisibleEntity> m_Visible;
+	};
+
+	void UpdateClient(Game* game, Entity entity, ClientInterest& interest, uint32_t tick, float view_radius);
+
+	std::unordered_map<Entity, ClientInterest> m_Clients;
+	std::vector<VisibleEntity> m_Scratch;
+	uint64_t m_TickVisiblePairs = 0;
+
+	// Statistics, published at the end of Update so PrintStats can read them from any thread
+	std::atomic<uint64_t> m_Entered{};
+	std::atomic<uint64_t> m_Left{};
+	std::atomic<uint64_t> m_ClientCount{};
+	std::atomic<uint64_t> m_VisiblePairs{};
+};
@@ -1,9 +1,12 @@
 #include "MovementSystem.h"
 #include "../GameServer/Game.h"
+#include "../GameServer/BitStream.h"
 
 void MovementSystem::Update(Game* game, float dt)
 {
 	EntityManager* ecs = game->GetECS();
+	std::shared_ptr<SpatialSystem> spatial_system = ecs->GetSystem<SpatialSystem>();
+	uint32_t tick = (uint32_t)game->GetElapsedTime() + 1;
 
 	for (const Entity& entity : m_Entities)
 	{
@@ -18,6 +21,7 @@ void MovementSystem::Update(Game* game, float dt)
 		if (world.IsInBounds(new_position * 0.01f) && new_position != transform.m_Position)
 		{
 			transform.m_Position = new_position;
+			spatial_system->Moved(entity, transform);
 			movement.m_Direction = { 0,0 };
 
 			Vector2Int previous_tile_position = movement.m_TilePosition;
@@ -29,12 +33,29 @@ void MovementSystem::Update(Game* game, float dt)
 				// Send new map data
 			}
 
+			// Snapshots replicate the new state at the end of the tick
+			if (game->GetNetwork()->GetSettings().m_Snapshots)
+			{
+				continue;
+			}
+
+			// Only players that have us in view are told, the view radius is the same both ways
+			const std::vector<VisibleEntity>* observers = ecs->GetSystem<InterestSystem>()->GetVisible(entity);
+			if (!observers)
+			{
+				continue;
+			}
+
+			// Movement: tick (16 bits, wraps around), id, position, speed
 			Connection& client = ecs->GetComponent<Connection>(entity);
 			NetworkMessage msg(PacketType::Movement, client.m_Endpoint);
-			msg.Write(client.m_Id);
-			msg.Write(transform.m_Position);
-			msg.Write(movement.m_Speed);
-			game->GetNetwork()->SendToAll(msg);
+			BitWriter writer(msg);
+			writer.WriteBits(tick & UINT16_MAX, 16);
+			writer.WriteCompactUint(client.m_Id);
+			writer.WriteVector3(transform.m_Position, WORLD_MIN_POSITION, WORLD_MAX_POSITION, WORLD_POSITION_PRECISION);
+			writer.WriteFloat(movement.m_Speed, 0.f, MAX_MOVEMENT_SPEED, MOVEMENT_SPEED_PRECISION);
+			writer.Flush();
+			game->GetNetwork()->SendToObservers(msg, *observers);
 		}
 	}
 }
@@ -0,0 +1,206 @@
+#include "SnapshotSystem.h"
+#include "../GameServer/Game.h"
+#include "../GameServer/BitStream.h"
+
+static const uint32_t POSITION_STEPS[3] =
+{
+	QuantizationSteps(WORLD_MIN_POSITION.x, WORLD_MAX_POSITION.x, WORLD_POSITION_PRECISION),
+	QuantizationSteps(WORLD_MIN_POSITION.y, WORLD_MAX_POSITION.y, WORLD_POSITION_PRECISION),
+	QuantizationSteps(WORLD_MIN_POSITION.z, WORLD_MAX_POSITION.z, WORLD_POSITION_PRECISION)
+};
+static const uint32_t SPEED_STEPS = QuantizationSteps(0.f, MAX_MOVEMENT_SPEED, MOVEMENT_SPEED_PRECISION);
+
+// Bits of the changed field mask
+const uint32_t FIELD_POSITION = 1 << 0;
+const uint32_t FIELD_SPEED = 1 << 1;
+const uint32_t FIELD_ROTATION = 1 << 2;
+const uint32_t FIELD_ALL = FIELD_POSITION | FIELD_SPEED | FIELD_ROTATION;
+
+void SnapshotSystem::Update(Game* game, float /*dt*/)
+{
+	Network* network = game->GetNetwork();
+	if (!network->GetSettings().m_Snapshots)
+	{
+		return;
+	}
+
+	// Same tick numbering as InterestSystem so entities entering the view can be matched against baselines
+	m_Tick = (uint32_t)game->GetElapsedTime() + 1;
+	Snapshot& snapshot = m_History[m_Tick & (SNAPSHOT_HISTORY - 1)];
+	Capture(game, snapshot);
+
+	EntityManager* ecs = game->GetECS();
+	std::shared_ptr<InterestSystem> interest = ecs->GetSystem<InterestSystem>();
+	for (const Entity& entity : m_Entities)
+	{
+		Connection& client = ecs->GetComponent<Connection>(entity);
+		const std::vector<VisibleEntity>* visible = interest->GetVisible(entity);
+		if (!client.m_Authorized || !visible)
+		{
+			continue;
+		}
+
+		// Delta against the newest snapshot the client acknowledged, if it is still in the history
+		uint32_t acked = client.m_Reliability->GetAckedTag();
+		const Snapshot* baseline = nullptr;
+		if (acked != 0 && m_Tick - acked < SNAPSHOT_HISTORY && m_History[acked & (SNAPSHOT_HISTORY - 1)].m_Tick == acked)
+		{
+			baseline = &m_History[acked & (SNAPSHOT_HISTORY - 1)];
+		}
+
+		NetworkMessage msg(PacketType::Snapshot, client.m_Endpoint);
+		BitWriter writer(msg);
+		bool changed = WriteDelta(writer, snapshot, baseline, *visible);
+		writer.Flush();
+
+		// A client known to be at its baseline needs nothing, unless that baseline is about to leave the history
+		if (!changed && baseline && client.m_Reliability->GetLastTrackedTag() == acked && m_Tick - acked < SNAPSHOT_HISTORY / 2)
+		{
+			continue;
+		}
+
+		network->SendTracked(msg, client, m_Tick);
+	}
+}
+
+void SnapshotSystem::Capture(Game* game, Snapshot& snapshot)
+{
+	EntityManager* ecs = game->GetECS();
+
+	snapshot.m_Tick = m_Tick;
+	snapshot.m_Entities.clear();
+	for (const Entity& entity : m_Entities)
+	{
+		const Connection& client = ecs->GetComponent<Connection>(entity);
+		if (!client.m_Authorized)
+		{
+			continue;
+		}
+
+		const Transform& transform = ecs->GetComponent<Transform>(entity);
+		const Movement& movement = ecs->GetComponent<Movement>(entity);
+
+		EntityState state;
+		state.m_Id = client.m_Id;
+		state.m_Position[0] = Quantize(transform.m_Position.x, WORLD_MIN_POSITION.x, WORLD_MAX_POSITION.x, POSITION_STEPS[0]);
+		state.m_Position[1] = Quantize(transform.m_Position.y, WORLD_MIN_POSITION.y, WORLD_MAX_POSITION.y, POSITION_STEPS[1]);
+		state.m_Position[2] = Quantize(transform.m_Position.z, WORLD_MIN_POSITION.z, WORLD_MAX_POSITION.z, POSITION_STEPS[2]);
+		state.m_Speed = Quantize(movement.m_Speed, 0.f, MAX_MOVEMENT_SPEED, SPEED_STEPS);
+		state.m_Rotation = PackQuaternion(transform.m_Rotation);
+		snapshot.m_Entities.push_back(state);
+	}
+
+	// Sorted by id so snapshots can be diffed in one pass
+	std::sort(snapshot.m_Entities.begin(), snapshot.m_Entities.end(), [](const EntityState& lhs, const EntityState& rhs)
+	{
+		return lhs.m_Id < rhs.m_Id;
+	});
+}
+
+// Snapshot: tick (32 bits), ticks back to the baseline (0 = none) followed by the changed entities in view.
+// Every entity entry starts with a continuation bit, the list ends with a 0 bit. Entities leaving the view
+// are announced with RemoveCreature by InterestSystem instead.
+// Returns false if nothing changed since the baseline
+bool SnapshotSystem::WriteDelta(BitWriter& writer, const Snapshot& snapshot, const Snapshot* baseline, const std::vector<VisibleEntity>& visible)
+{
+	writer.WriteBits(snapshot.m_Tick, 32);
+	writer.WriteInt(baseline ? (int32_t)(snapshot.m_Tick - baseline->m_Tick) : 0, 0, SNAPSHOT_HISTORY - 1);
+
+	// Both the view and the snapshots are sorted by id, so the lookups below only ever move forward
+	bool changed = false;
+	size_t current_index = 0, baseline_index = 0;
+	for (const VisibleEntity& entity : visible)
+	{
+		const EntityState* state = Find(snapshot.m_Entities, current_index, entity.m_Id);
+		if (!state)
+		{
+			continue;
+		}
+
+		// Entities that came into view after the baseline are sent in full
+		const EntityState* previous = nullptr;
+		if (baseline && entity.m_Since <= baseline->m_Tick)
+		{
+			previous = Find(baseline->m_Entities, baseline_index, entity.m_Id);
+		}
+
+		changed |= WriteEntity(writer, *state, previous);
+	}
+	writer.WriteBool(false);
+
+	return changed;
+}
+
+const SnapshotSystem::EntityState* SnapshotSystem::Find(const std::vector<EntityState>& entities, size_t& index, uint32_t id)
+{
+	// Binary search the rest, walking would make every client pay for all the players ahead of its view
+	index = std::lower_bound(entities.begin() + index, entities.end(), id, [](const EntityState& state, uint32_t value)
+	{
+		return state.m_Id < value;
+	}) - entities.begin();
+
+	if (index < entities.size() && entities[index].m_Id == id)
+	{
+		return &entities[index];
+	}
+
+	return nullptr;
+}
+
+// Entity: id, changed field mask and the changed fields. Positions are sent as small per axis
+// deltas when close to the baseline. Returns false and writes nothing if the entity did not change
+bool SnapshotSystem::WriteEntity(BitWriter& writer, const EntityState& state, const EntityState* baseline)
+{
+	uint32_t fields = FIELD_ALL;
+	bool near = false;
+	if (baseline)
+	{
+		fields = 0;
+		near = true;
+		for (size_t axis = 0; axis < 3; ++axis)
+		{
+			int64_t delta = (int64_t)state.m_Position[axis] - baseline->m_Position[axis];
+			fields |= delta != 0 ? FIELD_POSITION : 0;
+			near &= delta >= -SNAPSHOT_POSITION_DELTA && delta <= SNAPSHOT_POSITION_DELTA;
+		}
+		fields |= state.m_Speed != baseline->m_Speed ? FIELD_SPEED : 0;
+		fields |= state.m_Rotation != baseline->m_Rotation ? FIELD_ROTATION : 0;
+
+		if (fields == 0)
+		{
+			return false;
+		}
+	}
+
+	writer.WriteBool(true);
+	writer.WriteCompactUint(state.m_Id);
+	writer.WriteBits(fields, 3);
+
+	if (fields & FIELD_POSITION)
+	{
+		writer.WriteBool(near);
+		for (size_t axis = 0; axis < 3; ++axis)
+		{
+			if (near)
+			{
+				writer.WriteInt((int32_t)state.m_Position[axis] - (int32_t)baseline->m_Position[axis], -SNAPSHOT_POSITION_DELTA, SNAPSHOT_POSITION_DELTA);
+			}
+			else
+			{
+				writer.WriteBits(state.m_Position[axis], BitsRequired(POSITION_STEPS[axis]));
+			}
+		}
+	}
+
+	if (fields & FIELD_SPEED)
+	{
+		writer.WriteBits(state.m_Speed, BitsRequired(SPEED_STEPS));
+	}
+
+	if (fields & FIELD_ROTATION)
+	{
+		writer.WriteBits(state.m_Rotation, 2 + 3 * QUATERNION_COMPONENT_BITS);
+	}
+
+	return true;
+}
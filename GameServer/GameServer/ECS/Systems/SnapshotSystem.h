@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include "IEntitySystem.h"
+
+const uint32_t SNAPSHOT_HISTORY = 32;		// Ticks of snapshots kept as delta baselines, must be a power of two
+const int32_t SNAPSHOT_POSITION_DELTA = 255;	// Max change per axis, in quantization steps, that is sent relative to the baseline
+
+class BitWriter;
+struct VisibleEntity;
+class SnapshotSystem : public IEntitySystem
+{
+public:
+	void Update(Game* game, float dt) override;
+
+private:
+	// Replicated state of an entity, quantized the way it goes on the wire so unchanged values compare equal
+	struct EntityState
+	{
+		uint32_t m_Id;
+		uint32_t m_Position[3];
+		uint32_t m_Speed;
+		uint32_t m_Rotation;
+	};
+
+	struct Snapshot
+	{
+		uint32_t m_Tick = 0;
+		std::vector<EntityState> m_Entities;
+	};
+
+	void Capture(Game* game, Snapshot& snapshot);
+	bool WriteDelta(BitWriter& writer, const Snapshot& snapshot, const Snapshot* baseline, const std::vector<VisibleEntity>& visible);
+	const EntityState* Find(const std::vector<EntityState>& entities, size_t& index, uint32_t id);
+	bool WriteEntity(BitWriter& writer, const EntityState& state, const EntityState* baseline);
+
+	std::vector<Snapshot> m_History = std::vector<Snapshot>(SNAPSHOT_HISTORY);
+	uint32_t m_Tick = 0;
+};
@@ -0,0 +1,240 @@
+#include "SpatialSystem.h"
+#include "../GameServer/Game.h"
+
+SpatialSystem::SpatialSystem()
+{
+	m_GridSize = (WORLD_MAX_SIZE + SPATIAL_CELL_SIZE - 1) / SPATIAL_CELL_SIZE;
+	m_Cells.resize((size_t)m_GridSize * m_GridSize);
+	m_Locations.resize(MAX_ENTITIES, Location{ INVALID_CELL, 0 });
+}
+
+void SpatialSystem::Update(Game* game, float /*dt*/)
+{
+	// Only entities added since the last tick, the rest are kept up to date through Moved
+	EntityManager* ecs = game->GetECS();
+	for (Entity entity : m_Added)
+	{
+		// Removed again before it was inserted
+		if (m_Locations[entity].m_Cell != INVALID_CELL || m_Entities.find(entity) == m_Entities.end())
+		{
+			continue;
+		}
+
+		Vector2 position = ToGridPosition(ecs->GetComponent<Transform>(entity));
+		Insert(entity, ToCellIndex(position), position);
+	}
+	m_Added.clear();
+}
+
+void SpatialSystem::EntityAdded(Entity entity)
+{
+	m_Added.push_back(entity);
+}
+
+void SpatialSystem::EntityRemoved(Entity entity)
+{
+	if (m_Locations[entity].m_Cell != INVALID_CELL)
+	{
+		Remove(entity);
+	}
+}
+
+// Entities staying in their cell only get their position refreshed
+void SpatialSystem::Moved(Entity entity, const Transform& transform)
+{
+	Location& location = m_Locations[entity];
+	if (location.m_Cell == INVALID_CELL)
+	{
+		// Not inserted yet, Update picks up the new position
+		return;
+	}
+
+	Vector2 position = ToGridPosition(transform);
+	uint32_t cell = ToCellIndex(position);
+	if (location.m_Cell == cell)
+	{
+		m_Cells[cell][location.m_Slot].m_Position = position;
+		return;
+	}
+
+	Remove(entity);
+	Insert(entity, cell, position);
+	m_CellChanges++;
+}
+
+std::span<const Entity> SpatialSystem::QueryRadius(const Vector2& center, float radius)
+{
+	m_Results.clear();
+	m_Queries++;
+
+	float max_distance = radius * radius;
+	for (int y = ToCell(center.y - radius); y <= ToCell(center.y + radius); ++y)
+	{
+		for (int x = ToCell(center.x - radius); x <= ToCell(center.x + radius); ++x)
+		{
+			for (const Entry& entry : m_Cells[(size_t)y * m_GridSize + x])
+			{
+				float dx = entry.m_Position.x - center.x;
+				float dy = entry.m_Position.y - center.y;
+				if (dx * dx + dy * dy <= max_distance)
+				{
+					m_Results.push_back(entry.m_Entity);
+				}
+			}
+		}
+	}
+
+	return m_Results;
+}
+
+std::span<const Entity> SpatialSystem::QueryBox(const Vector2& min, const Vector2& max)
+{
+	m_Results.clear();
+	m_Queries++;
+
+	for (int y = ToCell(min.y); y <= ToCell(max.y); ++y)
+	{
+		for (int x = ToCell(min.x); x <= ToCell(max.x); ++x)
+		{
+			for (const Entry& entry : m_Cells[(size_t)y * m_GridSize + x])
+			{
+				const Vector2& position = entry.m_Position;
+				if (position.x >= min.x && position.x <= max.x && position.y >= min.y && position.y <= max.y)
+				{
+					m_Results.push_back(entry.m_Entity);
+				}
+			}
+		}
+	}
+
+	return m_Results;
+}
+
+std::span<const Entity> SpatialSystem::QueryNearest(const Vector2& center, size_t count, float max_radius)
+{
+	m_Results.clear();
+	m_Candidates.clear();
+	m_Queries++;
+	if (count == 0)
+	{
+		return {};
+	}
+
+	// Search rings of cells around the center until the closest count candidates are known to be
+	// closer than anything in the rings not searched yet
+	float max_distance = max_radius * max_radius;
+	int center_x = ToCell(center.x);
+	int center_y = ToCell(center.y);
+	for (int ring = 0; ring < m_GridSize; ++ring)
+	{
+		for (int y = center_y - ring; y <= center_y + ring; ++y)
+		{
+			if (y < 0 || y >= m_GridSize)
+			{
+				continue;
+			}
+
+			// Rows in between only have a cell on either side of the ring
+			int step = (ring == 0 || y == center_y - ring || y == center_y + ring) ? 1 : 2 * ring;
+			for (int x = center_x - ring; x <= center_x + ring; x += step)
+			{
+				if (x < 0 || x >= m_GridSize)
+				{
+					continue;
+				}
+
+				for (const Entry& entry : m_Cells[(size_t)y * m_GridSize + x])
+				{
+					float dx = entry.m_Position.x - center.x;
+					float dy = entry.m_Position.y - center.y;
+					float distance = dx * dx + dy * dy;
+					if (distance <= max_distance)
+					{
+						m_Candidates.push_back(Candidate{ distance, entry.m_Entity });
+					}
+				}
+			}
+		}
+
+		// Distance from the center to the closest point outside the rings searched so far
+		float reach = std::min({
+			center.x - (float)((center_x - ring) * SPATIAL_CELL_SIZE),
+			(float)((center_x + ring + 1) * SPATIAL_CELL_SIZE) - center.x,
+			center.y - (float)((center_y - ring) * SPATIAL_CELL_SIZE),
+			(float)((center_y + ring + 1) * SPATIAL_CELL_SIZE) - center.y });
+		reach = std::max(reach, 0.f);
+
+		if (reach * reach > max_distance)
+		{
+			break;
+		}
+
+		if (m_Candidates.size() >= count)
+		{
+			std::nth_element(m_Candidates.begin(), m_Candidates.begin() + (count - 1), m_Candidates.end(), [](const Candidate& lhs, const Candidate& rhs)
+			{
+				return lhs.m_Distance < rhs.m_Distance;
+			});
+
+			if (m_Candidates[count - 1].m_Distance <= reach * reach)
+			{
+				break;
+			}
+		}
+	}
+
+	size_t found = std::min(count, m_Candidates.size());
+	std::partial_sort(m_Candidates.begin(), m_Candidates.begin() + found, m_Candidates.end(), [](const Candidate& lhs, const Candidate& rhs)
+	{
+		return lhs.m_Distance < rhs.m_Distance;
+	});
+
+	for (size_t i = 0; i < found; ++i)
+	{
+		m_Results.push_back(m_Candidates[i].m_Entity);
+	}
+
+	return m_Results;
+}
+
+Vector2 SpatialSystem::ToGridPosition(const Transform& transform)
+{
+	return Vector2{ transform.m_Position.x / WORLD_TILE_SIZE, transform.m_Position.z / WORLD_TILE_SIZE };
+}
+
+void SpatialSystem::PrintStats()
+{
+	std::cout << "[Spatial] Entities: " << m_Size << " | Cell changes: " << m_CellChanges << " | Queries: " << m_Queries << std::endl;
+}
+
+void SpatialSystem::Insert(Entity entity, uint32_t cell, const Vector2& position)
+{
+	std::vector<Entry>& entries = m_Cells[cell];
+	m_Locations[entity] = Location{ cell, (uint32_t)entries.size() };
+	entries.push_back(Entry{ entity, position });
+	m_Size++;
+}
+
+void SpatialSystem::Remove(Entity entity)
+{
+	// Swap with the last entry of the cell so removal does not shift the others
+	Location& location = m_Locations[entity];
+	std::vector<Entry>& entries = m_Cells[location.m_Cell];
+	entries[location.m_Slot] = entries.back();
+	m_Locations[entries[location.m_Slot].m_Entity].m_Slot = location.m_Slot;
+	entries.pop_back();
+
+	location.m_Cell = INVALID_CELL;
+	m_Size--;
+}
+
+// Cell coordinate of a position in tiles, positions outside the world end up in the border cells
+int SpatialSystem::ToCell(float value)
+{
+	return (int)std::clamp(value / SPATIAL_CELL_SIZE, 0.f, (float)(m_GridSize - 1));
+}
+
+uint32_t SpatialSystem::ToCellIndex(const Vector2& position)
+{
+	return (uint32_t)(ToCell(position.y) * m_GridSize + ToCell(position.x));
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <span>
+#include <vector>
+#include "IEntitySystem.h"
+#include "../Components/Transform.h"
+
+const int SPATIAL_CELL_SIZE = 16;	// Width and height of a grid cell in tiles
+
+// Spatial hash over the ground plane of the world answering proximity queries without scanning every Transform.
+// Entities are kept in a uniform grid of cells, each cell stores its entities next to their positions so queries
+// never have to look up components. Positions are in tiles, x and z of the Transform.
+// The grid is kept up to date incrementally: new entities are inserted on the next Update and systems moving a
+// Transform report it through Moved, so the cost per tick follows the entities that changed rather than all of them.
+// Query results are spans into a buffer owned by the system, they stay valid until the next query
+class SpatialSystem : public IEntitySystem
+{
+public:
+	SpatialSystem();
+
+	void Update(Game* game, float dt) override;
+	void EntityAdded(Entity entity) override;
+	void EntityRemoved(Entity entity) override;
+
+	// Has to be called whenever the position of a Transform in the grid changes
+	void Moved(Entity entity, const Transform& transform);
+
+	// Entities within radius of center
+	std::span<const Entity> QueryRadius(const Vector2& center, float radius);
+	// Entities inside the box spanned by min and max
+	std::span<const Entity> QueryBox(const Vector2& min, const Vector2& max);
+	// Up to count entities closest to center within max_radius, nearest first
+	std::span<const Entity> QueryNearest(const Vector2& center, size_t count, float max_radius);
+
+	static Vector2 ToGridPosition(const Transform& transform);
+	void PrintStats();
+
+private:
+	struct Entry
+	{
+		Entity m_Entity;
+		Vector2 m_Position;
+	};
+
+	// Where an entity is stored, m_Cell is INVALID_CELL if it is not in the grid
+	struct Location
+	{
+		uint32_t m_Cell;
+		uint32_t m_Slot;
+	};
+
+	struct Candidate
+	{
+		float m_Distance;
+		Entity m_Entity;
+	};
+
+	static const uint32_t INVALID_CELL = UINT32_MAX;
+
+	void Insert(Entity entity, uint32_t cell, const Vector2& position);
+	void Remove(Entity entity);
+	int ToCell(float value);
+	uint32_t ToCellIndex(const Vector2& position);
+
+	int m_GridSize = 0;
+	std::vector<std::vector<Entry>> m_Cells;
+	std::vector<Location> m_Locations;
+	std::vector<Entity> m_Added;	// Inserted on the next Update, their Transform may not be set up yet when they are added
+	std::vector<Entity> m_Results;
+	std::vector<Candidate> m_Candidates;
+
+	// Statistics, PrintStats reads them from the console thread
+	std::atomic<uint64_t> m_Size{};
+	std::atomic<uint64_t> m_CellChanges{};
+	std::atomic<uint64_t> m_Queries{};
+};
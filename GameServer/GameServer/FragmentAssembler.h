@@ -0,0 +1,148 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <vector>
+#include "NetworkMessageReader.h"
+#include "MessageBundle.h"
+
+// Messages that do not fit a datagram on their own are split into Fragment messages of at most NET_MTU,
+// each fragment is sent, acknowledged and resent like any other message so losing one only costs that piece.
+// Fragment payload: packet type (uint16), group id (uint16), fragment index (uint8), fragment count (uint8), data
+const size_t FRAGMENT_HEADER_SIZE = 6;
+const size_t FRAGMENT_SIZE = NET_MTU - NET_PACKET_HEADER_SIZE - NET_MSG_HEADER_SIZE - FRAGMENT_HEADER_SIZE;	// Data per fragment, 1180 bytes: a fragment fills a datagram
+const size_t FRAGMENT_MAX_COUNT = 55;		// Max amount of fragments per message, keeps messages within the 16 bit length field
+static_assert(FRAGMENT_MAX_COUNT * FRAGMENT_SIZE <= UINT16_MAX, "A reassembled message has to fit the 16 bit length field.");
+const size_t FRAGMENT_MAX_GROUPS = 8;		// Max amount of messages being reassembled per connection
+const std::chrono::seconds FRAGMENT_TIMEOUT(10);	// Incomplete messages are given up on after this long
+
+// Largest payload sent without fragmenting
+const size_t NET_MAX_UNFRAGMENTED_SIZE = NET_MTU - NET_PACKET_HEADER_SIZE - NET_MSG_HEADER_SIZE;
+
+// Per connection reassembly of fragmented messages, memory is bounded by FRAGMENT_MAX_GROUPS messages of
+// FRAGMENT_MAX_COUNT fragments. When every group is in use the oldest incomplete message is dropped to make room
+class FragmentAssembler
+{
+public:
+	// Group id for the next message we split up
+	uint16_t NextGroup() { return m_NextGroup++; }
+	uint64_t GetDropped() { return m_Dropped; }
+
+	// Add a received fragment, returns a view of the whole message once its last fragment arrived.
+	// The view is valid until the next call
+	std::optional<NetworkMessageReader> Add(NetworkMessageReader& fragment, RetransmitScheduler::Clock::time_point now)
+	{
+		PacketType type = (PacketType)fragment.ReadUint16();
+		uint16_t group_id = fragment.ReadUint16();
+		uint8_t index = fragment.ReadUint8();
+		uint8_t count = fragment.ReadUint8();
+		size_t size = fragment.GetRemaining();
+		if (fragment.IsOverrun() || type >= PacketType::Fragment || count == 0 || count > FRAGMENT_MAX_COUNT || index >= count
+			|| size > FRAGMENT_SIZE || (index + 1 < count && size != FRAGMENT_SIZE))
+		{
+			return std::nullopt;
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		Group* group = Find(group_id, count, now);
+		if (!group || group->m_Complete || group->m_Received[index])
+		{
+			// Duplicate of a fragment we already have, or of a message that was already completed
+			return std::nullopt;
+		}
+
+		// Message header in front so the result reads like any other received message
+		size_t offset = NET_MSG_HEADER_SIZE + index * FRAGMENT_SIZE;
+		if (group->m_Data.size() < offset + size)
+		{
+			group->m_Data.resize(offset + size);
+		}
+		fragment.ReadArray(std::span<uint8_t>(group->m_Data.data() + offset, size));
+		group->m_Received[index] = true;
+
+		if (++group->m_ReceivedCount < count)
+		{
+			return std::nullopt;
+		}
+
+		// Keep the group around marked complete so late duplicates are not mistaken for a new message
+		group->m_Complete = true;
+		size_t length = group->m_Data.size() - NET_MSG_HEADER_SIZE;
+		NetworkMessage::WriteHeader(group->m_Data.data(), type, length, 0, fragment.GetChannelSequence());
+		return NetworkMessageReader(group->m_Data.data(), group->m_Data.size(), fragment.GetEndpoint());
+	}
+
+private:
+	struct Group
+	{
+		bool m_Used = false;
+		bool m_Complete = false;
+		uint16_t m_Id = 0;
+		uint8_t m_Count = 0;
+		uint8_t m_ReceivedCount = 0;
+		bool m_Received[FRAGMENT_MAX_COUNT]{};
+		RetransmitScheduler::Clock::time_point m_Started;
+		std::vector<uint8_t> m_Data;
+	};
+
+	Group* Find(uint16_t id, uint8_t count, RetransmitScheduler::Clock::time_point now)
+	{
+		Group* victim = nullptr;
+		for (Group& group : m_Groups)
+		{
+			if (group.m_Used && now - group.m_Started > FRAGMENT_TIMEOUT)
+			{
+				Release(group);
+			}
+
+			if (group.m_Used && group.m_Id == id)
+			{
+				// Same id with another count is a different message after the group ids wrapped
+				return group.m_Count == count ? &group : nullptr;
+			}
+
+			if (!victim || EvictFirst(group, *victim))
+			{
+				victim = &group;
+			}
+		}
+
+		if (victim->m_Used)
+		{
+			Release(*victim);
+		}
+
+		victim->m_Used = true;
+		victim->m_Id = id;
+		victim->m_Count = count;
+		victim->m_Started = now;
+		return victim;
+	}
+
+	// Free groups are taken first, then completed ones and only then the oldest message still being reassembled
+	static bool EvictFirst(const Group& group, const Group& other)
+	{
+		int rank = !group.m_Used ? 0 : group.m_Complete ? 1 : 2;
+		int other_rank = !other.m_Used ? 0 : other.m_Complete ? 1 : 2;
+		return rank < other_rank || (rank == other_rank && group.m_Started < other.m_Started);
+	}
+
+	void Release(Group& group)
+	{
+		if (!group.m_Complete)
+		{
+			m_Dropped++;
+		}
+
+		group.m_Used = false;
+		group.m_Complete = false;
+		group.m_ReceivedCount = 0;
+		std::fill(std::begin(group.m_Received), std::end(group.m_Received), false);
+		group.m_Data.clear();
+	}
+
+	std::mutex m_Mutex;
+	Group m_Groups[FRAGMENT_MAX_GROUPS];
+	std::atomic<uint16_t> m_NextGroup{};
+	std::atomic<uint64_t> m_Dropped{};
+};
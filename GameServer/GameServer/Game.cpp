@@ -35,24 +35,31 @@ void Game::Shutdown()
 
 void Game::Update()
 {
-	std::clock_t current_time = clock();
+	// Wall time, clock() only counts the CPU time of the process and falls behind while the thread sleeps
+	std::chrono::steady_clock::time_point current_time = std::chrono::steady_clock::now();
 	double accumulator = 0.0;
 
 	while (IsRunning())
 	{
 		std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		std::clock_t new_time = clock();
-		double frame_time = double(new_time - current_time) / CLOCKS_PER_SEC;
+		std::chrono::steady_clock::time_point new_time = std::chrono::steady_clock::now();
+		double frame_time = std::chrono::duration<double>(new_time - current_time).count();
 		current_time = new_time;
 
 		accumulator += frame_time;
 
 		while (IsRunning() && accumulator >= m_DeltaTime)
 		{
+			std::chrono::steady_clock::time_point tick_start = std::chrono::steady_clock::now();
+
+			// Everything received since the last tick, the receive threads never touch the ECS themselves
+			m_Network.ProcessInbound();
 			for (const std::shared_ptr<IEntitySystem>& system : m_EntityManager->GetSystems())
 			{
 				system->Update(this, m_DeltaTime);
 			}
+			m_Network.Flush();
+			m_TickTimes.Record(std::chrono::steady_clock::now() - tick_start);
 
 			accumulator -= m_DeltaTime;
 			m_ElapsedTime++;
@@ -60,6 +67,17 @@ void Game::Update()
 	}
 }
 
+void Game::PrintStats()
+{
+	uint64_t budget = (uint64_t)(m_DeltaTime * 1000000);
+	std::cout << "[Game] Ticks: " << m_TickTimes.GetCount() << " | Avg: " << m_TickTimes.GetAverage() << " us";
+	std::cout << " | p50: <= " << m_TickTimes.GetPercentile(0.5) << " us | p99: <= " << m_TickTimes.GetPercentile(0.99) << " us";
+	std::cout << " | Max: " << m_TickTimes.GetMax() << " us | Over budget: " << m_TickTimes.GetCountOver(budget) << std::endl;
+	std::cout << "\tTick time | ";
+	m_TickTimes.Print(std::cout);
+	std::cout << std::endl;
+}
+
 void Game::RegisterEntityComponents()
 {
 	std::clock_t current_time = clock();
@@ -85,6 +103,9 @@ void Game::RegisterEntitySystems()
 	m_EntityManager->RegisterSystem<ConnectionSystem>();
 	m_EntityManager->RegisterSystem<MovementSystem>();
 	m_EntityManager->RegisterSystem<WorldSystem>();
+	m_EntityManager->RegisterSystem<SpatialSystem>();
+	m_EntityManager->RegisterSystem<InterestSystem>();
+	m_EntityManager->RegisterSystem<SnapshotSystem>();
 
 	SetSystemSignatures();
 	std::clock_t new_time = clock();
@@ -111,4 +132,23 @@ void Game::SetSystemSignatures()
 	signature.set(m_EntityManager->GetComponentType<World>());
 	m_EntityManager->SetSystemSignature<WorldSystem>(signature);
 	signature.reset();
+
+	// Spatial System
+	signature.set(m_EntityManager->GetComponentType<Transform>());
+	m_EntityManager->SetSystemSignature<SpatialSystem>(signature);
+	signature.reset();
+
+	// Interest System
+	signature.set(m_EntityManager->GetComponentType<Connection>());
+	signature.set(m_EntityManager->GetComponentType<Transform>());
+	signature.set(m_EntityManager->GetComponentType<Movement>());
+	m_EntityManager->SetSystemSignature<InterestSystem>(signature);
+	signature.reset();
+
+	// Snapshot System
+	signature.set(m_EntityManager->GetComponentType<Connection>());
+	signature.set(m_EntityManager->GetComponentType<Transform>());
+	signature.set(m_EntityManager->GetComponentType<Movement>());
+	m_EntityManager->SetSystemSignature<SnapshotSystem>(signature);
+	signature.reset();
 }
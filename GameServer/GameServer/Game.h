@@ -2,6 +2,7 @@
 #include <thread>
 #include <iostream>
 #include "Network.h"
+#include "DurationHistogram.h"
 #include "ECS/EntityManager.h"
 
 // Entity Components
@@ -14,11 +15,14 @@
 #include "ECS/Systems/ConnectionSystem.h"
 #include "ECS/Systems/MovementSystem.h"
 #include "ECS/Systems/WorldSystem.h"
+#include "ECS/Systems/SpatialSystem.h"
+#include "ECS/Systems/InterestSystem.h"
+#include "ECS/Systems/SnapshotSystem.h"
 
 class Game
 {
 public:
-	Game(uint16_t port) : m_Network(this, port), m_EntityManager(new EntityManager) {}
+	Game(uint16_t port, const NetworkSettings& settings = NetworkSettings{}) : m_Network(this, port, settings), m_EntityManager(new EntityManager) {}
 	~Game();
 
 	bool IsRunning() { return m_IsRunning; }
@@ -26,6 +30,7 @@ public:
 	void Start();
 	void Shutdown();
 	void Update();
+	void PrintStats();
 	EntityManager* GetECS() { return m_EntityManager; }
 	Network* GetNetwork() { return &m_Network; }
 	uint64_t GetElapsedTime() { return m_ElapsedTime; }
@@ -36,9 +41,10 @@ private:
 	void SetSystemSignatures();
 
 private:
-	bool m_IsRunning = false;
+	std::atomic<bool> m_IsRunning{ false };	// Read by the network threads
 	uint64_t m_ElapsedTime = 0;
 	const float m_DeltaTime = 0.01f;
+	DurationHistogram m_TickTimes;	// From draining the inbound queue to handing the outgoing messages over
 	std::thread m_Update;
 	Network m_Network;
 	EntityManager* m_EntityManager = nullptr;
@@ -0,0 +1,161 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include "NetworkMessage.h"
+#include "RetransmitScheduler.h"
+#include "ECS/Components/Connection.h"
+
+// Why received traffic was dropped before any handler saw it
+enum class IngressDrop : uint8_t
+{
+	Malformed,		// Datagram does not split into whole messages or names an unknown packet type
+	UnexpectedType,	// Packet type only the server sends
+	DatagramRate,	// Connection sends more datagrams than a client ever would
+	MessageRate,	// Packet type arrives faster than its limit, reliable ones are not acked and get resent later
+	HandshakeRate,	// Endpoint without a connection asks for challenges too often
+	QueueFull,		// Inbound queue to the simulation is full, reliable messages are not acked and get resent later
+	MAX_SIZE
+};
+
+inline const char* GetIngressDropName(IngressDrop reason)
+{
+	switch (reason)
+	{
+	case IngressDrop::Malformed:		return "malformed datagram";
+	case IngressDrop::UnexpectedType:	return "unexpected packet type";
+	case IngressDrop::DatagramRate:		return "datagram over rate";
+	case IngressDrop::MessageRate:		return "message over rate";
+	case IngressDrop::HandshakeRate:	return "handshake over rate";
+	case IngressDrop::QueueFull:		return "message, inbound queue full";
+	default:							return "unknown";
+	}
+}
+
+// Tokens refilled per second and the most a bucket saves up
+struct IngressLimit
+{
+	float m_Rate;
+	float m_Burst;
+};
+
+const IngressLimit INGRESS_DATAGRAM_LIMIT{ 250.f, 100.f };		// Per connection, all packet types together
+const IngressLimit INGRESS_HANDSHAKE_LIMIT{ 4.f, 4.f };			// Per endpoint without a connection
+const IngressLimit INGRESS_CHALLENGE_LIMIT{ 5000.f, 1000.f };	// All endpoints without a connection together
+const size_t INGRESS_HANDSHAKE_SLOTS = 4096;					// Endpoints sharing a slot share its bucket
+
+// What a client may send of each packet type, a rate of 0 means clients never send it
+inline IngressLimit GetIngressLimit(PacketType type)
+{
+	switch (type)
+	{
+	case PacketType::Disconnect:	return { 1.f, 2.f };
+	case PacketType::HandShake:		return { 2.f, 4.f };
+	case PacketType::Acknowledge:	return { 250.f, 100.f };
+	case PacketType::Ping:			return { 4.f, 4.f };
+	case PacketType::Movement:		return { 120.f, 60.f };
+	case PacketType::Fragment:		return { 120.f, 120.f };
+	default:						return { 0.f, 0.f };
+	}
+}
+
+// Starts full so a new sender gets its whole burst
+class TokenBucket
+{
+public:
+	bool Take(const IngressLimit& limit, RetransmitScheduler::Clock::time_point now)
+	{
+		if (m_Last == RetransmitScheduler::Clock::time_point{})
+		{
+			m_Tokens = limit.m_Burst;
+		}
+		else
+		{
+			float elapsed = std::chrono::duration<float>(now - m_Last).count();
+			m_Tokens = std::min(limit.m_Burst, m_Tokens + std::max(elapsed, 0.f) * limit.m_Rate);
+		}
+		m_Last = now;
+
+		if (m_Tokens < 1.f)
+		{
+			return false;
+		}
+		m_Tokens -= 1.f;
+		return true;
+	}
+
+private:
+	float m_Tokens = 0.f;
+	RetransmitScheduler::Clock::time_point m_Last{};
+};
+
+// Token buckets of a connection, one for its datagrams and one per packet type.
+// Not thread safe, an endpoint is only ever read by the receive thread of its shard
+class IngressLimiter
+{
+public:
+	bool TakeDatagram(RetransmitScheduler::Clock::time_point now)
+	{
+		return m_Datagrams.Take(INGRESS_DATAGRAM_LIMIT, now);
+	}
+
+	bool TakeMessage(PacketType type, RetransmitScheduler::Clock::time_point now)
+	{
+		return m_Messages[(size_t)type].Take(GetIngressLimit(type), now);
+	}
+
+private:
+	TokenBucket m_Datagrams;
+	TokenBucket m_Messages[(size_t)PacketType::MAX_SIZE];
+};
+
+// Checks run on every datagram before it is decoded, plus the handshake buckets of endpoints without a connection.
+// Those are hashed into a fixed table instead of stored per endpoint so spoofed sources can not grow it
+class IngressFilter
+{
+public:
+	// Every message header is followed by its whole payload, nothing is left over and every type is known
+	static bool IsWellFormed(const uint8_t* data, size_t size)
+	{
+		size_t offset = NET_PACKET_HEADER_SIZE;
+		if (size < offset + NET_MSG_HEADER_SIZE)
+		{
+			return false;
+		}
+
+		while (offset + NET_MSG_HEADER_SIZE <= size)
+		{
+			uint16_t type = data[offset] | data[offset + 1] << 8;
+			size_t length = (size_t)data[offset + 2] | (size_t)data[offset + 3] << 8;
+			if (type >= (uint16_t)PacketType::MAX_SIZE)
+			{
+				return false;
+			}
+			offset += NET_MSG_HEADER_SIZE + length;
+		}
+		return offset == size;
+	}
+
+	static bool IsExpected(PacketType type)
+	{
+		return type < PacketType::MAX_SIZE && GetIngressLimit(type).m_Rate > 0.f;
+	}
+
+	// Charges the endpoint's slot and the shared budget for a HandShake that gets a Challenge or a cookie check
+	bool TakeHandshake(const asio::ip::udp::endpoint& endpoint, RetransmitScheduler::Clock::time_point now)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		TokenBucket& slot = m_Handshakes[EndpointHash()(endpoint) % INGRESS_HANDSHAKE_SLOTS];
+		return slot.Take(INGRESS_HANDSHAKE_LIMIT, now) && m_Challenges.Take(INGRESS_CHALLENGE_LIMIT, now);
+	}
+
+	void Drop(IngressDrop reason) { m_Dropped[(size_t)reason]++; }
+	uint64_t GetDropped(IngressDrop reason) { return m_Dropped[(size_t)reason]; }
+
+private:
+	std::mutex m_Mutex;
+	TokenBucket m_Handshakes[INGRESS_HANDSHAKE_SLOTS];
+	TokenBucket m_Challenges;
+	std::atomic<uint64_t> m_Dropped[(size_t)IngressDrop::MAX_SIZE]{};
+};
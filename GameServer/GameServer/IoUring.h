@@ -0,0 +1,408 @@
+#pragma once
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+
+const uint32_t URING_QUEUE_DEPTH = 256;		// Submission entries per ring, larger send batches are submitted in parts
+const uint32_t URING_BUFFER_COUNT = 1024;	// Provided receive buffers per socket, a power of two
+const uint32_t URING_BUFFER_SIZE = 2048;	// Per datagram: recvmsg header and source address ahead of the payload
+
+// Bare io_uring on the raw syscalls, there is no liburing dependency. Not thread safe, every ring has one user
+class IoUring
+{
+public:
+	IoUring() = default;
+	IoUring(const IoUring&) = delete;
+	IoUring& operator=(const IoUring&) = delete;
+
+	~IoUring()
+	{
+		if (m_Sqes != MAP_FAILED)
+		{
+			munmap(m_Sqes, m_SqesSize);
+		}
+		if (m_Ring != MAP_FAILED)
+		{
+			munmap(m_Ring, m_RingSize);
+		}
+		if (m_Fd >= 0)
+		{
+			close(m_Fd);
+		}
+	}
+
+	// Returns 0 or the errno the kernel failed with
+	int Setup(uint32_t entries, uint32_t cq_entries)
+	{
+		io_uring_params params{};
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = cq_entries;
+		m_Fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+		if (m_Fd < 0)
+		{
+			return errno;
+		}
+
+		// Waiting with a timeout needs EXT_ARG (5.11), one mapping for both queues SINGLE_MMAP (5.4)
+		if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+		{
+			return ENOSYS;
+		}
+
+		m_RingSize = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(uint32_t), params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+		m_Ring = mmap(nullptr, m_RingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd, IORING_OFF_SQ_RING);
+		if (m_Ring == MAP_FAILED)
+		{
+			return errno;
+		}
+
+		m_SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		m_Sqes = mmap(nullptr, m_SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd, IORING_OFF_SQES);
+		if (m_Sqes == MAP_FAILED)
+		{
+			return errno;
+		}
+
+		uint8_t* ring = (uint8_t*)m_Ring;
+		m_SqHead = (uint32_t*)(ring + params.sq_off.head);
+		m_SqTail = (uint32_t*)(ring + params.sq_off.tail);
+		m_SqMask = *(uint32_t*)(ring + params.sq_off.ring_mask);
+		m_SqEntries = params.sq_entries;
+		m_CqHead = (uint32_t*)(ring + params.cq_off.head);
+		m_CqTail = (uint32_t*)(ring + params.cq_off.tail);
+		m_CqMask = *(uint32_t*)(ring + params.cq_off.ring_mask);
+		m_Cqes = (io_uring_cqe*)(ring + params.cq_off.cqes);
+
+		// Submission slots map to entries one to one, the array is never touched again
+		uint32_t* array = (uint32_t*)(ring + params.sq_off.array);
+		for (uint32_t i = 0; i < params.sq_entries; ++i)
+		{
+			array[i] = i;
+		}
+
+		m_LocalTail = *m_SqTail;
+		return 0;
+	}
+
+	int GetFd() { return m_Fd; }
+
+	// Next free submission entry cleared to zero, nullptr while the queue is full
+	io_uring_sqe* GetSqe()
+	{
+		uint32_t head = __atomic_load_n(m_SqHead, __ATOMIC_ACQUIRE);
+		if (m_LocalTail - head >= m_SqEntries)
+		{
+			return nullptr;
+		}
+
+		io_uring_sqe* sqe = &((io_uring_sqe*)m_Sqes)[m_LocalTail & m_SqMask];
+		memset(sqe, 0, sizeof(io_uring_sqe));
+		m_LocalTail++;
+		m_Unsubmitted++;
+		return sqe;
+	}
+
+	// Submit queued entries and wait for wait_count completions, or until the timeout when one is given.
+	// Returns the result of io_uring_enter, a negative errno on failure
+	int Enter(uint32_t wait_count, const std::chrono::nanoseconds* timeout = nullptr)
+	{
+		__atomic_store_n(m_SqTail, m_LocalTail, __ATOMIC_RELEASE);
+
+		uint32_t flags = wait_count > 0 ? IORING_ENTER_GETEVENTS : 0;
+		__kernel_timespec ts{};
+		io_uring_getevents_arg arg{};
+		const void* argp = nullptr;
+		size_t argsz = 0;
+		if (timeout)
+		{
+			ts.tv_sec = timeout->count() / 1000000000;
+			ts.tv_nsec = timeout->count() % 1000000000;
+			arg.sigmask_sz = _NSIG / 8;
+			arg.ts = (uint64_t)&ts;
+			argp = &arg;
+			argsz = sizeof(arg);
+			flags |= IORING_ENTER_EXT_ARG;
+		}
+
+		int result = (int)syscall(__NR_io_uring_enter, m_Fd, m_Unsubmitted, wait_count, flags, argp, argsz);
+		if (result < 0)
+		{
+			return -errno;
+		}
+
+		m_Unsubmitted -= std::min<uint32_t>(m_Unsubmitted, (uint32_t)result);
+		return result;
+	}
+
+	// Hand every available completion to callback, returns how many there were
+	template<typename Callback>
+	uint32_t Reap(Callback&& callback)
+	{
+		uint32_t head = *m_CqHead;
+		uint32_t tail = __atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE);
+		uint32_t count = tail - head;
+		for (; head != tail; ++head)
+		{
+			callback(m_Cqes[head & m_CqMask]);
+		}
+		__atomic_store_n(m_CqHead, head, __ATOMIC_RELEASE);
+		return count;
+	}
+
+private:
+	int m_Fd = -1;
+	void* m_Ring = MAP_FAILED;
+	size_t m_RingSize = 0;
+	void* m_Sqes = MAP_FAILED;
+	size_t m_SqesSize = 0;
+	uint32_t* m_SqHead = nullptr;
+	uint32_t* m_SqTail = nullptr;
+	uint32_t m_SqMask = 0;
+	uint32_t m_SqEntries = 0;
+	uint32_t m_LocalTail = 0;
+	uint32_t m_Unsubmitted = 0;
+	uint32_t* m_CqHead = nullptr;
+	uint32_t* m_CqTail = nullptr;
+	uint32_t m_CqMask = 0;
+	io_uring_cqe* m_Cqes = nullptr;
+};
+
+// Receives datagrams of one UDP socket with a single multishot recvmsg, the kernel picks a buffer from a ring of
+// provided buffers for every datagram. One io_uring_enter reaps as many datagrams as arrived since the last one.
+// Needs Linux 6.0, only used by the receive thread of its socket
+class UdpReceiveRing
+{
+public:
+	~UdpReceiveRing()
+	{
+		if (m_Buffers != MAP_FAILED)
+		{
+			munmap(m_Buffers, (size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+		}
+		if (m_BufferRing != MAP_FAILED)
+		{
+			munmap(m_BufferRing, URING_BUFFER_COUNT * sizeof(io_uring_buf));
+		}
+	}
+
+	// Returns 0 or the errno the kernel failed with
+	int Open(int socket)
+	{
+		m_Socket = socket;
+		if (int error = m_Ring.Setup(URING_QUEUE_DEPTH, URING_BUFFER_COUNT * 2))
+		{
+			return error;
+		}
+
+		m_Buffers = mmap(nullptr, (size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		m_BufferRing = mmap(nullptr, URING_BUFFER_COUNT * sizeof(io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (m_Buffers == MAP_FAILED || m_BufferRing == MAP_FAILED)
+		{
+			return ENOMEM;
+		}
+
+		io_uring_buf_reg reg{};
+		reg.ring_addr = (uint64_t)m_BufferRing;
+		reg.ring_entries = URING_BUFFER_COUNT;
+		reg.bgid = 0;
+		if (syscall(__NR_io_uring_register, m_Ring.GetFd(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		{
+			return errno;
+		}
+
+		for (uint16_t i = 0; i < URING_BUFFER_COUNT; ++i)
+		{
+			Recycle(i);
+		}
+		PublishBuffers();
+
+		// Only the source address is asked for, the kernel writes it ahead of the payload in each buffer
+		m_Header.msg_namelen = sizeof(sockaddr_storage);
+		return Arm() ? 0 : EBUSY;
+	}
+
+	// Wait up to timeout for datagrams and hand each one to handle(data, size, address, address_size).
+	// Returns the amount of datagrams handled or a negative errno
+	template<typename Callback>
+	int Receive(std::chrono::nanoseconds timeout, Callback&& handle)
+	{
+		if (!m_Armed && !Arm())
+		{
+			return -EBUSY;
+		}
+
+		int result = m_Ring.Enter(1, &timeout);
+		if (result < 0 && result != -ETIME && result != -EINTR)
+		{
+			return result;
+		}
+
+		int received = 0;
+		int error = 0;
+		m_Ring.Reap([&](const io_uring_cqe& cqe)
+		{
+			// Multishot stops when the kernel runs out of buffers or on errors, it is armed again below
+			if (!(cqe.flags & IORING_CQE_F_MORE))
+			{
+				m_Armed = false;
+			}
+
+			if (cqe.res < 0 || !(cqe.flags & IORING_CQE_F_BUFFER))
+			{
+				if (cqe.res != -ENOBUFS)
+				{
+					error = cqe.res;
+				}
+				return;
+			}
+
+			uint16_t id = (uint16_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+			uint8_t* buffer = (uint8_t*)m_Buffers + (size_t)id * URING_BUFFER_SIZE;
+			const io_uring_recvmsg_out* out = (const io_uring_recvmsg_out*)buffer;
+			const uint8_t* address = buffer + sizeof(io_uring_recvmsg_out);
+			const uint8_t* payload = address + m_Header.msg_namelen + m_Header.msg_controllen;
+			if (out->flags & MSG_TRUNC)
+			{
+				m_Truncated++;
+			}
+			else if (out->payloadlen > 0)
+			{
+				handle(payload, (size_t)out->payloadlen, (const sockaddr*)address, (size_t)std::min<uint32_t>(out->namelen, m_Header.msg_namelen));
+				received++;
+			}
+			Recycle(id);
+		});
+		PublishBuffers();
+
+		return error < 0 && received == 0 ? error : received;
+	}
+
+	uint64_t GetTruncated() { return m_Truncated; }
+
+private:
+	IoUring m_Ring;
+	int m_Socket = -1;
+	msghdr m_Header{};
+	void* m_Buffers = MAP_FAILED;
+	void* m_BufferRing = MAP_FAILED;
+	uint16_t m_BufferTail = 0;
+	bool m_Armed = false;
+	uint64_t m_Truncated = 0;
+
+	bool Arm()
+	{
+		io_uring_sqe* sqe = m_Ring.GetSqe();
+		if (!sqe)
+		{
+			return false;
+		}
+
+		sqe->opcode = IORING_OP_RECVMSG;
+		sqe->fd = m_Socket;
+		sqe->addr = (uint64_t)&m_Header;
+		sqe->len = 1;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = 0;
+		m_Armed = true;
+		return true;
+	}
+
+	// Give a buffer back to the kernel, visible to it after PublishBuffers
+	void Recycle(uint16_t id)
+	{
+		// Indexed by hand, the flexible bufs member of io_uring_buf_ring sits at the wrong offset when compiled as C++
+		io_uring_buf& buf = ((io_uring_buf*)m_BufferRing)[m_BufferTail & (URING_BUFFER_COUNT - 1)];
+		buf.addr = (uint64_t)((uint8_t*)m_Buffers + (size_t)id * URING_BUFFER_SIZE);
+		buf.len = URING_BUFFER_SIZE;
+		buf.bid = id;
+		m_BufferTail++;
+	}
+
+	void PublishBuffers()
+	{
+		__atomic_store_n(&((io_uring_buf_ring*)m_BufferRing)->tail, m_BufferTail, __ATOMIC_RELEASE);
+	}
+};
+
+// Sends a batch of datagrams with one io_uring_enter per URING_QUEUE_DEPTH of them and waits for their completions,
+// so the caller may reuse the datagram memory as soon as Send returns. Used under the send lock of its socket
+class UdpSendRing
+{
+public:
+	// Returns 0 or the errno the kernel failed with
+	int Open(int socket)
+	{
+		m_Socket = socket;
+		return m_Ring.Setup(URING_QUEUE_DEPTH, URING_QUEUE_DEPTH * 2);
+	}
+
+	// Every header's msg_len is set to the bytes sent, failed datagrams are left at 0. Returns false if
+	// io_uring_enter itself failed, the ring can not be used anymore and the unsent datagrams have to go another way.
+	// calls is the amount of io_uring_enter calls made, error the first failing errno
+	bool Send(mmsghdr* headers, size_t count, size_t& calls, int& error)
+	{
+		calls = 0;
+		error = 0;
+		for (size_t offset = 0; offset < count;)
+		{
+			uint32_t batch = 0;
+			while (offset + batch < count)
+			{
+				io_uring_sqe* sqe = m_Ring.GetSqe();
+				if (!sqe)
+				{
+					break;
+				}
+
+				headers[offset + batch].msg_len = 0;
+				sqe->opcode = IORING_OP_SENDMSG;
+				sqe->fd = m_Socket;
+				sqe->addr = (uint64_t)&headers[offset + batch].msg_hdr;
+				sqe->len = 1;
+				sqe->user_data = offset + batch;
+				batch++;
+			}
+
+			uint32_t completed = 0;
+			while (completed < batch)
+			{
+				// The entries stay queued when the call fails, so it has to be retried until they are in
+				int result = m_Ring.Enter(batch - completed);
+				calls++;
+				completed += m_Ring.Reap([&](const io_uring_cqe& cqe)
+				{
+					if (cqe.res >= 0)
+					{
+						headers[cqe.user_data].msg_len = (unsigned int)cqe.res;
+					}
+					else if (error == 0)
+					{
+						error = -cqe.res;
+					}
+				});
+
+				// Anything but a transient failure would fail the same way forever
+				if (result < 0 && result != -EINTR && result != -EAGAIN && result != -EBUSY)
+				{
+					error = -result;
+					return false;
+				}
+			}
+			offset += batch;
+		}
+		return true;
+	}
+
+private:
+	IoUring m_Ring;
+	int m_Socket = -1;
+};
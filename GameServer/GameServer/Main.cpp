@@ -5,8 +5,50 @@
 int main(int argc, char** argv)
 {
     const uint16_t server_port = 7171;
+    NetworkSettings settings;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--no-batch")
+        {
+            settings.m_BatchedIO = false;
+        }
+        else if (arg == "--io-uring")
+        {
+            settings.m_IoUring = true;
+        }
+        else if (arg == "--batch-size" && i + 1 < argc)
+        {
+            settings.m_BatchSize = (uint16_t)std::stoi(argv[++i]);
+        }
+        else if (arg == "--shards" && i + 1 < argc)
+        {
+            settings.m_ReceiveShards = (uint16_t)std::stoi(argv[++i]);
+        }
+        else if (arg == "--no-send-thread")
+        {
+            settings.m_SendThread = false;
+        }
+        else if (arg == "--no-snapshots")
+        {
+            settings.m_Snapshots = false;
+        }
+        else if (arg == "--view-radius" && i + 1 < argc)
+        {
+            settings.m_ViewRadius = (uint16_t)std::stoi(argv[++i]);
+        }
+        else if (arg == "--send-rate" && i + 1 < argc)
+        {
+            settings.m_SendRate = (uint32_t)std::stoi(argv[++i]) * 1024;
+        }
+        else if (arg == "--max-send-rate" && i + 1 < argc)
+        {
+            settings.m_MaxSendRate = (uint32_t)std::stoi(argv[++i]) * 1024;
+        }
+    }
+
     std::cout << "Starting gameserver on port " << server_port << std::endl;
-    Game game(server_port);
+    Game game(server_port, settings);
     game.Start();
 
     std::string input;
@@ -18,6 +60,17 @@ int main(int argc, char** argv)
         {
             game.Shutdown();
         }
+        else if (input == "/stats")
+        {
+            game.PrintStats();
+            game.GetNetwork()->PrintStats();
+            game.GetECS()->GetSystem<SpatialSystem>()->PrintStats();
+            game.GetECS()->GetSystem<InterestSystem>()->PrintStats();
+        }
+        else if (input == "/connections")
+        {
+            game.GetNetwork()->PrintConnections();
+        }
     }
     return EXIT_SUCCESS;
 }
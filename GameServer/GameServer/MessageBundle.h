@@ -0,0 +1,208 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include "ReliableWindow.h"
+
+const size_t NET_MTU = 1200;	// Max size of a bundled datagram, stays below common path MTUs
+
+// Outgoing per connection buffer packing the messages sent during a tick into as few datagrams as possible,
+// each datagram starts with the packet header followed by the messages back to back.
+// Only headers are copied into the bundle, payloads are gathered from their shared buffers when the datagram is sent.
+// Datagrams are only sent as far as the connection's send budget allows, on a flush over budget unreliable messages
+// are dropped since newer state supersedes them, reliable ones stay in order at the front for the next flush.
+// Reliable messages only enter the window and get their sequence id once they are sent, so whatever waits here
+// never takes up room in the window nor gets resent
+class MessageBundle
+{
+public:
+	MessageBundle(const std::shared_ptr<ReliableWindow>& window, RetransmitScheduler& scheduler) : m_Window(window), m_Scheduler(scheduler) {}
+
+	const asio::ip::udp::endpoint& GetEndpoint() { return m_Window->GetEndpoint(); }
+	uint64_t GetDropped() { return m_Dropped; }
+	uint64_t GetHeldBack() { return m_HeldBack; }
+
+	// Append a message, transmit(buffers) is called right away for every datagram filled up within the budget.
+	// sequence_id is the id of a tracked message, reliable ones get theirs when sent.
+	// Returns true if the bundle was empty and has to be queued for the next flush
+	template<typename Func>
+	bool Append(PacketType type, uint16_t channel_sequence, const SharedPayload& payload, uint16_t sequence_id, bool reliable, Func transmit)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Entries.push_back(Entry{ m_Headers.size(), payload, type, channel_sequence, sequence_id, reliable, false });
+		m_Headers.resize(m_Headers.size() + NET_MSG_HEADER_SIZE);
+		NetworkMessage::WriteHeader(m_Headers.data() + m_Entries.back().m_HeaderOffset, type, payload->size(), sequence_id, channel_sequence);
+		m_Size += NET_MSG_HEADER_SIZE + payload->size();
+
+		if (NET_PACKET_HEADER_SIZE + m_Size > NET_MTU)
+		{
+			Send(transmit, false);
+		}
+
+		bool queue = !m_Queued;
+		m_Queued = true;
+		return queue;
+	}
+
+	// Send whatever is left in the bundle as far as the budget allows.
+	// Returns true if reliable messages were held back and the bundle has to be queued for the next flush again
+	template<typename Func>
+	bool Flush(Func transmit)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		Send(transmit, true);
+		HoldBack();
+		m_Queued = !m_Entries.empty();
+		return m_Queued;
+	}
+
+	static void ReadPacketHeader(const uint8_t* data, uint16_t& ack, uint32_t& ack_bits)
+	{
+		ack = (uint16_t)(data[0] | data[1] << 8);
+		ack_bits = 0;
+		for (size_t i = 0; i < sizeof(uint32_t); ++i)
+		{
+			ack_bits |= (uint32_t)data[2 + i] << (8 * i);
+		}
+	}
+
+private:
+	struct Entry
+	{
+		size_t m_HeaderOffset;
+		SharedPayload m_Payload;
+		PacketType m_Type;
+		uint16_t m_ChannelSequence;
+		uint16_t m_Sequence;
+		bool m_Reliable;
+		bool m_HeldBack;
+	};
+
+	// Pack messages from the front into datagrams, the last partially filled one only when flushing
+	template<typename Func>
+	void Send(Func transmit, bool flush)
+	{
+		RetransmitScheduler::Clock::time_point now = RetransmitScheduler::Clock::now();
+		while (m_Begin < m_Entries.size())
+		{
+			size_t end = m_Begin;
+			size_t size = NET_PACKET_HEADER_SIZE;
+			do
+			{
+				size += NET_MSG_HEADER_SIZE + m_Entries[end].m_Payload->size();
+				end++;
+			} while (end < m_Entries.size() && size + NET_MSG_HEADER_SIZE + m_Entries[end].m_Payload->size() <= NET_MTU);
+
+			if ((end == m_Entries.size() && !flush) || !m_Window->ConsumeBudget(size, now))
+			{
+				return;
+			}
+
+			Close(m_Begin, end, transmit, now);
+			m_Size -= size - NET_PACKET_HEADER_SIZE;
+			m_Begin = end;
+		}
+	}
+
+	template<typename Func>
+	void Close(size_t begin, size_t end, Func transmit, RetransmitScheduler::Clock::time_point now)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			Entry& entry = m_Entries[i];
+			if (entry.m_Reliable)
+			{
+				entry.m_Sequence = m_Window->Push(entry.m_Type, entry.m_ChannelSequence, entry.m_Payload, now);
+				NetworkMessage::WriteHeader(m_Headers.data() + entry.m_HeaderOffset, entry.m_Type, entry.m_Payload->size(), entry.m_Sequence, entry.m_ChannelSequence);
+				m_Scheduler.Schedule(m_Window, entry.m_Sequence, now + m_Window->GetRetransmitTimeout());
+			}
+			else if (entry.m_Sequence != 0)
+			{
+				m_TrackedIds.push_back(entry.m_Sequence);
+			}
+		}
+
+		// Acks are stamped last so they are as fresh as possible
+		m_Window->WritePacketHeader(m_PacketHeader);
+
+		// Headers of consecutive messages with empty payloads end up in the same buffer
+		m_Buffers.clear();
+		m_Buffers.push_back(asio::buffer(m_PacketHeader));
+		bool extend = false;
+		for (size_t i = begin; i < end; ++i)
+		{
+			const Entry& entry = m_Entries[i];
+			if (extend)
+			{
+				asio::const_buffer& last = m_Buffers.back();
+				last = asio::buffer(last.data(), last.size() + NET_MSG_HEADER_SIZE);
+			}
+			else
+			{
+				m_Buffers.push_back(asio::buffer(m_Headers.data() + entry.m_HeaderOffset, NET_MSG_HEADER_SIZE));
+			}
+
+			extend = entry.m_Payload->empty();
+			if (!extend)
+			{
+				m_Buffers.push_back(asio::buffer(*entry.m_Payload));
+			}
+		}
+
+		transmit(m_Buffers);
+		m_Window->MarkSent(m_TrackedIds, now);
+		m_TrackedIds.clear();
+	}
+
+	// Drop the unreliable messages left over budget and move the reliable ones to the front
+	void HoldBack()
+	{
+		m_KeptHeaders.clear();
+		size_t kept = 0;
+		for (size_t i = m_Begin; i < m_Entries.size(); ++i)
+		{
+			Entry& entry = m_Entries[i];
+			if (!entry.m_Reliable)
+			{
+				m_Size -= NET_MSG_HEADER_SIZE + entry.m_Payload->size();
+				m_Dropped++;
+				continue;
+			}
+
+			if (!entry.m_HeldBack)
+			{
+				entry.m_HeldBack = true;
+				m_HeldBack++;
+			}
+
+			const uint8_t* header = m_Headers.data() + entry.m_HeaderOffset;
+			entry.m_HeaderOffset = m_KeptHeaders.size();
+			m_KeptHeaders.insert(m_KeptHeaders.end(), header, header + NET_MSG_HEADER_SIZE);
+			if (kept != i)
+			{
+				m_Entries[kept] = std::move(entry);
+			}
+			kept++;
+		}
+
+		m_Entries.resize(kept);
+		m_Headers.swap(m_KeptHeaders);
+		m_Begin = 0;
+	}
+
+	std::shared_ptr<ReliableWindow> m_Window;
+	RetransmitScheduler& m_Scheduler;
+	std::mutex m_Mutex;
+	std::vector<uint8_t> m_Headers;
+	std::vector<uint8_t> m_KeptHeaders;
+	std::vector<Entry> m_Entries;
+	size_t m_Begin = 0;		// First entry not sent yet
+	size_t m_Size = 0;		// Bytes of the messages not sent yet
+	uint8_t m_PacketHeader[NET_PACKET_HEADER_SIZE]{};
+	DatagramBuffers m_Buffers;
+	std::vector<uint16_t> m_TrackedIds;
+	bool m_Queued = false;
+	std::atomic<uint64_t> m_Dropped{};
+	std::atomic<uint64_t> m_HeldBack{};
+};
@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+
+// Bounded lock-free queue for many producers and one consumer, after Dmitry Vyukov's bounded MPMC queue.
+// Every slot carries a sequence telling whose turn it is: producers claim a position with a CAS on the tail and
+// publish the slot by advancing its sequence, the consumer frees it the same way. Values stay in their slot and
+// are filled and read in place, so a T holding a vector keeps its capacity between uses.
+// Room is accounted for separately from the slots so a producer can reserve it for several values up front,
+// a reservation holds against every other producer until it is pushed into or given back
+template<typename T>
+class MpscQueue
+{
+public:
+	// capacity has to be a power of two
+	MpscQueue(size_t capacity) : m_Slots(capacity), m_Mask(capacity - 1), m_Free(capacity)
+	{
+		assert(capacity > 0 && (capacity & m_Mask) == 0 && "Capacity is not a power of two.");
+		for (size_t i = 0; i < capacity; ++i)
+		{
+			m_Slots[i].m_Sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	// Claim a slot and fill(T&) it, returns false without calling fill when the queue is full. Any thread
+	template<typename Fill>
+	bool Push(Fill&& fill)
+	{
+		if (!Reserve(1))
+		{
+			return false;
+		}
+
+		PushReserved(fill);
+		return true;
+	}
+
+	// Set aside room for count values, all or nothing. Any thread
+	bool Reserve(size_t count)
+	{
+		size_t free = m_Free.load(std::memory_order_relaxed);
+		do
+		{
+			if (free < count)
+			{
+				return false;
+			}
+		} while (!m_Free.compare_exchange_weak(free, free - count, std::memory_order_acquire, std::memory_order_relaxed));
+		return true;
+	}
+
+	// Give back reserved room that will not be pushed into. Any thread
+	void Unreserve(size_t count)
+	{
+		m_Free.fetch_add(count, std::memory_order_release);
+	}
+
+	// Fill(T&) a slot out of room reserved before, never fails. Any thread
+	template<typename Fill>
+	void PushReserved(Fill&& fill)
+	{
+		// The reservation guarantees the slot at the tail was freed, other producers can only beat us to it
+		size_t position = m_Tail.load(std::memory_order_relaxed);
+		while (true)
+		{
+			Slot& slot = m_Slots[position & m_Mask];
+			size_t sequence = slot.m_Sequence.load(std::memory_order_acquire);
+			if (sequence == position && m_Tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				fill(slot.m_Value);
+				slot.m_Sequence.store(position + 1, std::memory_order_release);
+				return;
+			}
+
+			if (sequence != position)
+			{
+				position = m_Tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Oldest published value or nullptr, it stays valid until Pop. Consumer thread only
+	T* Front()
+	{
+		size_t head = m_Head.load(std::memory_order_relaxed);
+		Slot& slot = m_Slots[head & m_Mask];
+		if (slot.m_Sequence.load(std::memory_order_acquire) != head + 1)
+		{
+			return nullptr;
+		}
+		return &slot.m_Value;
+	}
+
+	// Hand the slot of Front back to the producers. Consumer thread only
+	void Pop()
+	{
+		size_t head = m_Head.load(std::memory_order_relaxed);
+		m_Slots[head & m_Mask].m_Sequence.store(head + m_Slots.size(), std::memory_order_release);
+		m_Head.store(head + 1, std::memory_order_relaxed);
+		m_Free.fetch_add(1, std::memory_order_release);
+	}
+
+	// Claimed slots, may include some a producer is still filling
+	size_t Size()
+	{
+		size_t head = m_Head.load(std::memory_order_relaxed);
+		size_t tail = m_Tail.load(std::memory_order_relaxed);
+		return tail > head ? tail - head : 0;
+	}
+
+	size_t Capacity() { return m_Slots.size(); }
+
+private:
+	struct Slot
+	{
+		std::atomic<size_t> m_Sequence;
+		T m_Value;
+	};
+
+	std::vector<Slot> m_Slots;
+	size_t m_Mask;
+	alignas(64) std::atomic<size_t> m_Tail{};
+	alignas(64) std::atomic<size_t> m_Head{};
+	alignas(64) std::atomic<size_t> m_Free;	// Room neither reserved nor holding a value
+};
@@ -2,6 +2,64 @@
 #include "Game.h"
 #include "NetworkMessage.h"
 
+#ifdef NET_HAS_BATCHED_IO
+#include <netinet/in.h>
+#endif
+
+Network::Network(Game* game, uint16_t port, const NetworkSettings& settings) : m_Game(game), m_Settings(settings), m_Rpc(this)
+{
+	size_t shard_count = 1;
+#ifdef NET_HAS_REUSEPORT
+	shard_count = std::max<size_t>(1, m_Settings.m_ReceiveShards);
+#endif
+
+	asio::ip::udp::endpoint local_endpoint(asio::ip::udp::v4(), port);
+	for (size_t i = 0; i < shard_count; ++i)
+	{
+		std::unique_ptr<Shard> shard = std::make_unique<Shard>(m_Context, i);
+		shard->m_Socket.open(local_endpoint.protocol());
+#ifdef NET_HAS_REUSEPORT
+		if (shard_count > 1)
+		{
+			// Let the kernel hash each remote endpoint onto one of the sockets sharing this port
+			shard->m_Socket.set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+		}
+#endif
+		shard->m_Socket.bind(local_endpoint);
+		shard->m_ReceiveBuffer.resize(NET_MSG_MAX_SIZE);
+		m_Shards.push_back(std::move(shard));
+	}
+
+#ifdef NET_HAS_IO_URING
+	if (m_Settings.m_IoUring)
+	{
+		// Every shard gets its rings or none does, kernels without io_uring (or with it disabled) keep the other paths
+		int error = 0;
+		for (std::unique_ptr<Shard>& shard : m_Shards)
+		{
+			int socket = shard->m_Socket.native_handle();
+			shard->m_ReceiveRing = std::make_unique<UdpReceiveRing>();
+			shard->m_SendRing = std::make_unique<UdpSendRing>();
+			if ((error = shard->m_ReceiveRing->Open(socket)) != 0 || (error = shard->m_SendRing->Open(socket)) != 0)
+			{
+				break;
+			}
+		}
+
+		m_UringIO = error == 0;
+		if (!m_UringIO)
+		{
+			std::cout << "[Network] io_uring unavailable: " << strerror(error) << ", falling back to " << (IsBatchedIO() ? "recvmmsg" : "blocking receive") << std::endl;
+			for (std::unique_ptr<Shard>& shard : m_Shards)
+			{
+				shard->m_ReceiveRing.reset();
+				shard->m_SendRing.reset();
+			}
+		}
+	}
+#endif
+}
+
 Network::~Network()
 {
 	if (m_Game->IsRunning())
@@ -13,116 +71,310 @@ Network::~Network()
 void Network::Start()
 {
 	std::cout << "\nInitialize Network..." << std::endl;
-	m_Listener = std::thread(&Network::Listen, this);
+	std::cout << "\tBatched I/O...\t\t" << (IsBatchedIO() ? "Enabled" : "Disabled") << std::endl;
+	std::cout << "\tio_uring...\t\t" << (IsUringIO() ? "Enabled" : "Disabled") << std::endl;
+	std::cout << "\tReceive shards...\t" << m_Shards.size() << std::endl;
+	std::cout << "\tSender thread...\t" << (m_Settings.m_SendThread ? "Enabled" : "Disabled") << std::endl;
+	std::cout << "\tSnapshots...\t\t" << (m_Settings.m_Snapshots ? "Enabled" : "Disabled") << std::endl;
+	std::cout << "\tSend rate...\t\t" << m_Settings.m_SendRate / 1024 << " - " << m_Settings.m_MaxSendRate / 1024 << " KB/s" << std::endl;
+	for (std::unique_ptr<Shard>& shard : m_Shards)
+	{
+		shard->m_Listener = std::thread(&Network::Listen, this, std::ref(*shard));
+	}
+	if (m_Settings.m_SendThread)
+	{
+		m_Sender = std::thread(&Network::SendOutbound, this);
+	}
+	m_Dispatcher = std::thread(&Network::Dispatch, this);
 }
 
 void Network::Shutdown()
 {
-	m_Socket.close();
+	// The simulation has stopped, whatever it handed over is still sent
+	if (m_Sender.joinable())
+	{
+		m_SenderStop = true;
+		WakeSender();
+		m_Sender.join();
+	}
+
+	// Wake up any thread blocked in a receive call before closing
+	for (std::unique_ptr<Shard>& shard : m_Shards)
+	{
+		asio::error_code ec;
+		shard->m_Socket.shutdown(asio::socket_base::shutdown_both, ec);
+		shard->m_Socket.close(ec);
+	}
+
+	for (std::unique_ptr<Shard>& shard : m_Shards)
+	{
+		shard->m_Listener.join();
+	}
 
-	m_Listener.join();
+	m_Scheduler.Stop();
 	m_Dispatcher.join();
 }
 
 void Network::Send(NetworkMessage& msg)
 {
-	if (msg.GetSequenceId() > 0)
-	{
-		//std::cout << "Send type: " << (int)msg.GetType() << " Sequence: " << msg.GetSequenceId() << std::endl;
-		msg.SetDispatchTimestamp(m_Game->GetElapsedTime());
-		m_Socket.send_to(asio::buffer(msg.GetData()), msg.GetEndpoint());
+	SharedPayload payload = msg.GetPayload();
+	m_PayloadsSerialized++;
 
-		m_DispatchMutex.lock();
-		m_DispatchList.push_back(msg);
-		m_DispatchMutex.unlock();
-	}
-	else
+	ConnectionRegistry::Entry entry = m_Connections.Get(msg.GetEndpoint());
+	if (entry.m_Connection)
 	{
-		m_Socket.send_to(asio::buffer(msg.GetData()), msg.GetEndpoint());
+		Post(msg.GetType(), payload, *entry.m_Connection);
+		return;
 	}
+
+	// No connection to bundle with, send it on its own without acks
+	uint8_t header[NET_PACKET_HEADER_SIZE + NET_MSG_HEADER_SIZE]{};
+	NetworkMessage::WriteHeader(header + NET_PACKET_HEADER_SIZE, msg.GetType(), payload->size(), 0, 0);
+	DatagramBuffers buffers{ asio::buffer(header), asio::buffer(*payload) };
+	Transmit(buffers, msg.GetEndpoint());
+	m_MessagesSent++;
 }
 
 void Network::SendToAll(NetworkMessage& msg, Connection* ignore)
 {
+	// Serialized once, every recipient only gets its own header
+	SharedPayload payload = msg.GetPayload();
+	m_PayloadsSerialized++;
+
+	m_Connections.ForEach([this, &msg, &payload, ignore](Entity /*entity*/, const Connection& client)
+	{
+		if (ignore && client.m_Endpoint == ignore->m_Endpoint)
+		{
+			return;
+		}
+
+		Post(msg.GetType(), payload, client);
+	});
+}
+
+// Send to every player in an area of interest, serialized once like SendToAll
+void Network::SendToObservers(NetworkMessage& msg, const std::vector<VisibleEntity>& observers)
+{
+	SharedPayload payload = msg.GetPayload();
+	m_PayloadsSerialized++;
+
 	EntityManager* ecs = m_Game->GetECS();
-	std::vector<Entity> entities = ecs->GetEntities();
-
-	for (Entity entity : entities)
-	{
-		const Connection& client = ecs->GetComponent<Connection>(entity);
-		if (client.m_Endpoint.size() > 0)
-		{
-			if (ignore)
-			{
-				if (client.m_Endpoint != ignore->m_Endpoint)
-				{
-					if (msg.GetSequenceId() > 0)
-					{
-						// Add to reliable queue
-						NetworkMessage copy_msg(msg.GetData());
-						copy_msg.SetEndpoint(client.m_Endpoint);
-						copy_msg.SetDispatchTimestamp(m_Game->GetElapsedTime());
-						m_Socket.send_to(asio::buffer(copy_msg.GetData()), copy_msg.GetEndpoint());
-
-						m_DispatchMutex.lock();
-						m_DispatchList.push_back(copy_msg);
-						m_DispatchMutex.unlock();
-					}
-					else
-					{
-						msg.SetEndpoint(client.m_Endpoint);
-						m_Socket.send_to(asio::buffer(msg.GetData()), msg.GetEndpoint());
-					}
-				}
+	for (const VisibleEntity& observer : observers)
+	{
+		Post(msg.GetType(), payload, ecs->GetComponent<Connection>(observer.m_Entity));
+	}
+}
+
+// Send an unreliable message whose acknowledgement is reported through the client's ReliableWindow::GetAckedTag
+void Network::SendTracked(NetworkMessage& msg, const Connection& client, uint32_t tag)
+{
+	Post(msg.GetType(), msg.GetPayload(), client, tag);
+	m_PayloadsSerialized++;
+}
+
+// Hand a message to the sender thread, or send it right away when there is none
+void Network::Post(PacketType type, const SharedPayload& payload, const Connection& client, uint32_t tag)
+{
+	if (!m_Settings.m_SendThread)
+	{
+		SendTo(type, payload, client, tag);
+		return;
+	}
+
+	PushOutbound([&](OutboundCommand& command)
+	{
+		command.m_Flush = false;
+		command.m_Client = client;
+		command.m_Type = type;
+		command.m_Payload = payload;
+		command.m_Tag = tag;
+	});
+}
+
+template<typename Fill>
+void Network::PushOutbound(Fill fill)
+{
+	if (m_Outbound.Push(fill))
+	{
+		return;
+	}
+
+	// The sender thread is a whole queue behind, hold the tick until it makes room rather than lose reliable messages
+	m_OutboundStalls++;
+	do
+	{
+		WakeSender();
+		std::this_thread::yield();
+	} while (!m_Outbound.Push(fill));
+}
+
+void Network::WakeSender()
+{
+	m_SenderWakeups++;
+	m_SenderWakeups.notify_one();
+}
+
+// Bundles and sends what the simulation handed over, woken up at the end of every tick. Messages are taken in the
+// order they were posted, so channel sequences and bundles come out the same as when sent from the tick itself
+void Network::SendOutbound()
+{
+	uint64_t wakeups = 0;
+	bool stop = false;
+	while (!stop)
+	{
+		m_SenderWakeups.wait(wakeups);
+		wakeups = m_SenderWakeups;
+		stop = m_SenderStop;
+
+		RetransmitScheduler::Clock::time_point start = RetransmitScheduler::Clock::now();
+		OutboundCommand* command = nullptr;
+		while ((command = m_Outbound.Front()) != nullptr)
+		{
+			if (command->m_Flush)
+			{
+				FlushBundles();
+				RetransmitScheduler::Clock::time_point now = RetransmitScheduler::Clock::now();
+				m_SendTimes.Record(now - start);
+				start = now;
 			}
 			else
 			{
-				if (msg.GetSequenceId() > 0)
-				{
-					// Add to reliable queue
-					NetworkMessage copy_msg(msg.GetData());
-					copy_msg.SetEndpoint(client.m_Endpoint);
-					copy_msg.SetDispatchTimestamp(m_Game->GetElapsedTime());
-					m_Socket.send_to(asio::buffer(copy_msg.GetData()), copy_msg.GetEndpoint());
-
-					m_DispatchMutex.lock();
-					m_DispatchList.push_back(copy_msg);
-					m_DispatchMutex.unlock();
-				}
-				else
-				{
-					msg.SetEndpoint(client.m_Endpoint);
-					m_Socket.send_to(asio::buffer(msg.GetData()), msg.GetEndpoint());
-				}
+				SendTo(command->m_Type, command->m_Payload, command->m_Client, command->m_Tag);
 			}
+
+			// The slot is reused, the payload and transport state are not
+			command->m_Payload.reset();
+			command->m_Client = Connection{};
+			m_Outbound.Pop();
+		}
+	}
+}
+
+// Add a message to the client's bundle, reliable messages get their sequence id and are kept in the window
+// once the bundle sends them. Sequenced and ordered channels number the message within its stream
+void Network::SendTo(PacketType type, const SharedPayload& payload, const Connection& client, uint32_t tag)
+{
+	ChannelInfo channel = GetChannel(type);
+	uint16_t channel_sequence = channel.IsSequenced() ? client.m_Channels->NextSequence(channel.m_Stream) : 0;
+
+	if (payload->size() > NET_MAX_UNFRAGMENTED_SIZE)
+	{
+		SendFragments(type, channel_sequence, payload, client, tag);
+		return;
+	}
+
+	uint16_t sequence_id = 0;
+	if (!channel.IsReliable() && tag != 0)
+	{
+		sequence_id = client.m_Reliability->PushTracked(tag);
+	}
+
+	Append(type, payload, sequence_id, channel_sequence, channel.IsReliable(), client);
+}
+
+// Split a message too large for a datagram into datagram sized fragments, reliable fragments are acknowledged
+// and resent one by one. Every fragment carries the channel sequence of the whole message
+void Network::SendFragments(PacketType type, uint16_t channel_sequence, const SharedPayload& payload, const Connection& client, uint32_t tag)
+{
+	bool reliable = GetChannel(type).IsReliable();
+	size_t count = (payload->size() + FRAGMENT_SIZE - 1) / FRAGMENT_SIZE;
+	if (count > FRAGMENT_MAX_COUNT)
+	{
+		std::cout << "Dropped message | type: " << (int)type << " | " << payload->size() << " bytes exceed the fragment limit" << std::endl;
+		return;
+	}
+
+	uint16_t group = client.m_Fragments->NextGroup();
+	uint16_t tracked_id = 0;
+	if (!reliable && tag != 0)
+	{
+		tracked_id = client.m_Reliability->PushTracked(tag, (uint32_t)count);
+	}
+
+	std::span<const uint8_t> data(*payload);
+	uint16_t sequence_id = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		std::span<const uint8_t> chunk = data.subspan(i * FRAGMENT_SIZE, std::min(FRAGMENT_SIZE, data.size() - i * FRAGMENT_SIZE));
+
+		NetworkMessage fragment(PacketType::Fragment, client.m_Endpoint);
+		fragment.Write((uint16_t)type);
+		fragment.Write(group);
+		fragment.Write((uint8_t)i);
+		fragment.Write((uint8_t)count);
+		fragment.Write(chunk);
+		SharedPayload fragment_payload = fragment.GetPayload();
+
+		// Tracked fragments got consecutive ids, skipping 0 when wrapping
+		if (tracked_id != 0)
+		{
+			sequence_id = i == 0 ? tracked_id : NextSequenceId(sequence_id);
 		}
+
+		Append(PacketType::Fragment, fragment_payload, sequence_id, channel_sequence, reliable, client);
+	}
+
+	m_MessagesFragmented++;
+	m_FragmentsSent += count;
+}
+
+void Network::Append(PacketType type, const SharedPayload& payload, uint16_t sequence_id, uint16_t channel_sequence, bool reliable, const Connection& client)
+{
+	const asio::ip::udp::endpoint& endpoint = client.m_Endpoint;
+	bool queue = client.m_Bundle->Append(type, channel_sequence, payload, sequence_id, reliable, [this, &endpoint](const DatagramBuffers& buffers)
+	{
+		Transmit(buffers, endpoint);
+	});
+	m_MessagesSent++;
+
+	if (queue)
+	{
+		m_BundleMutex.lock();
+		m_PendingBundles.push_back(client.m_Bundle);
+		m_BundleMutex.unlock();
 	}
 }
 
 void Network::TerminateClient(const Connection& client)
 {
 	std::cout << "New Disconnect | " << client.m_Endpoint << " | id: " << client.m_Id << std::endl;
-	NetworkMessage msg(PacketType::Disconnect, client.m_Endpoint, true);
+	NetworkMessage msg(PacketType::Disconnect, client.m_Endpoint);
 	Send(msg);
 
+	// The scheduler keeps the window alive until the Disconnect is acknowledged or timed out,
+	// the pending bundle list until it has been flushed
 	EntityManager* ecs = m_Game->GetECS();
-	Entity entity = ecs->GetEntityFromEndpoint(client.m_Endpoint);
-	if (entity <= MAX_ENTITIES)
+	Entity entity = m_Connections.Find(client.m_Endpoint);
+	if (entity < MAX_ENTITIES)
 	{
+		m_Connections.Remove(client.m_Endpoint);
 		ecs->DestroyEntity(entity);
 	}
 }
 
-void Network::Listen()
+void Network::Listen(Shard& shard)
 {
-	std::cout << "\tListner thread...\tRunning" << std::endl;
-	m_Dispatcher = std::thread(&Network::Dispatch, this);
+	std::cout << "\tListner thread " << shard.m_Index << "...\tRunning" << std::endl;
+
+	if (IsUringIO())
+	{
+		ListenUring(shard);
+		return;
+	}
+
+	if (IsBatchedIO())
+	{
+		ListenBatched(shard);
+		return;
+	}
 
 	while (m_Game->IsRunning())
 	{
 		try
 		{
-			m_ReceivedSize = m_Socket.receive_from(asio::buffer(m_ReceiveBuffer), m_RemoteEndpoint);
+			shard.m_ReceivedSize = 0;
+			shard.m_ReceivedSize = shard.m_Socket.receive_from(asio::buffer(shard.m_ReceiveBuffer), shard.m_RemoteEndpoint);
+			shard.m_ReceiveCalls++;
 		}
 		catch (const std::exception& ex)
 		{
@@ -132,116 +384,730 @@ void Network::Listen()
 			}
 		}
 
-		if (m_Game->IsRunning() && m_ReceivedSize > 0)
+		if (m_Game->IsRunning() && shard.m_ReceivedSize > 0)
 		{
-			Handle(m_ReceiveBuffer, m_RemoteEndpoint);
+			shard.m_PacketsReceived++;
+			Handle(shard.m_ReceiveBuffer.data(), shard.m_ReceivedSize, shard.m_RemoteEndpoint);
 		}
 	}
 }
 
-void Network::Dispatch()
+void Network::ListenBatched(Shard& shard)
 {
-	std::unordered_map<uint32_t, const asio::ip::udp::endpoint&> timeout_msgs;
-	std::cout << "\tDispatch thread...\tRunning\n" << std::endl;
+#ifdef NET_HAS_BATCHED_IO
+	const size_t batch_size = m_Settings.m_BatchSize;
+	std::vector<mmsghdr> headers(batch_size);
+	std::vector<iovec> iov(batch_size);
+	std::vector<sockaddr_storage> addresses(batch_size);
+	std::vector<uint8_t> buffers(batch_size * NET_MSG_MAX_SIZE);
+
+	int socket = shard.m_Socket.native_handle();
 	while (m_Game->IsRunning())
 	{
-		if (m_DispatchList.size() > 0)
+		for (size_t i = 0; i < batch_size; ++i)
+		{
+			iov[i].iov_base = &buffers[i * NET_MSG_MAX_SIZE];
+			iov[i].iov_len = NET_MSG_MAX_SIZE;
+			headers[i].msg_hdr = {};
+			headers[i].msg_hdr.msg_name = &addresses[i];
+			headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+			headers[i].msg_hdr.msg_iov = &iov[i];
+			headers[i].msg_hdr.msg_iovlen = 1;
+			headers[i].msg_len = 0;
+		}
+
+		// Block until at least one datagram is available, then drain up to batch_size without blocking
+		int received = recvmmsg(socket, headers.data(), (unsigned int)batch_size, MSG_WAITFORONE, nullptr);
+		if (received < 0)
 		{
-			m_DispatchMutex.lock();
-			for (NetworkMessage& msg : m_DispatchList)
+			if (m_Game->IsRunning() && errno != EINTR)
 			{
-				EntityManager* ecs = m_Game->GetECS();
-				Entity entity = ecs->GetEntityFromEndpoint(msg.GetEndpoint());
-				Connection& connection = ecs->GetComponent<Connection>(entity);
+				std::cout << "\nException: recvmmsg failed with errno " << errno << "\n" << std::endl;
+			}
+			continue;
+		}
 
-				uint64_t timestamp = m_Game->GetElapsedTime() - msg.GetDispatchTimestamp();
-				if (timestamp >= connection.m_RoundtripTime)
-				{
-					msg.SetDispatchTimestamp(m_Game->GetElapsedTime());
-					m_Socket.send_to(asio::buffer(msg.GetData()), msg.GetEndpoint());
+		shard.m_ReceiveCalls++;
+		shard.m_PacketsReceived += received;
 
-					if (msg.Timeout())
-					{
-						timeout_msgs.emplace(msg.GetSequenceId(), msg.GetEndpoint());
-					}
-				}
+		for (int i = 0; i < received && m_Game->IsRunning(); ++i)
+		{
+			if (headers[i].msg_len == 0)
+			{
+				continue;
+			}
 
+			memcpy(shard.m_RemoteEndpoint.data(), &addresses[i], headers[i].msg_hdr.msg_namelen);
+			shard.m_RemoteEndpoint.resize(headers[i].msg_hdr.msg_namelen);
+
+			Handle(&buffers[i * NET_MSG_MAX_SIZE], headers[i].msg_len, shard.m_RemoteEndpoint);
+		}
+
+		// Datagrams generated while handling this batch go out together
+		FlushSendQueues();
+	}
+#endif
+}
+
+void Network::ListenUring(Shard& shard)
+{
+#ifdef NET_HAS_IO_URING
+	// Closing the socket does not end the multishot receive, the wait times out now and then to notice a shutdown
+	const std::chrono::milliseconds wait(100);
+	while (m_Game->IsRunning())
+	{
+		int received = shard.m_ReceiveRing->Receive(wait, [this, &shard](const uint8_t* data, size_t size, const sockaddr* address, size_t address_size)
+		{
+			if (!m_Game->IsRunning())
+			{
+				return;
+			}
+
+			memcpy(shard.m_RemoteEndpoint.data(), address, address_size);
+			shard.m_RemoteEndpoint.resize(address_size);
+			Handle(data, size, shard.m_RemoteEndpoint);
+		});
+
+		shard.m_ReceiveCalls++;
+		if (received < 0)
+		{
+			if (m_Game->IsRunning())
+			{
+				std::cout << "\nException: io_uring receive failed with errno " << -received << "\n" << std::endl;
 			}
-			m_DispatchMutex.unlock();
+			continue;
+		}
+		shard.m_PacketsReceived += received;
+
+		// Datagrams generated while handling this batch go out together
+		FlushSendQueues();
+	}
+#endif
+}
+
+void Network::Dispatch()
+{
+	std::cout << "\tDispatch thread...\tRunning\n" << std::endl;
+
+	// Sleeps until the earliest retransmit deadline and only touches the messages that are due
+	std::vector<RetransmitScheduler::Entry> due;
+	std::vector<RetransmitScheduler::Entry> reschedule;
+	while (m_Scheduler.WaitForDue(due))
+	{
+		RetransmitScheduler::Clock::time_point now = RetransmitScheduler::Clock::now();
+		for (RetransmitScheduler::Entry& entry : due)
+		{
+			ReliableWindow& window = *entry.m_Window;
+			bool resend = window.Retransmit(entry.m_Sequence, now, [this, &window](const DatagramBuffers& buffers)
+			{
+				Transmit(buffers, window.GetEndpoint());
+				m_Retransmissions++;
+			}, entry.m_Deadline);
+
+			if (resend)
+			{
+				reschedule.push_back(std::move(entry));
+			}
+		}
+
+		m_Scheduler.Reschedule(reschedule);
+		reschedule.clear();
+		due.clear();
+		FlushSendQueues();
+	}
+}
+
+void Network::Handle(const uint8_t* data, size_t size, const asio::ip::udp::endpoint& remote_endpoint)
+{
+	// Framing is checked once up front so nothing below works on a datagram it would have to abandon halfway
+	if (!IngressFilter::IsWellFormed(data, size))
+	{
+		DropIngress(IngressDrop::Malformed, remote_endpoint);
+		return;
+	}
+
+	RetransmitScheduler::Clock::time_point now = RetransmitScheduler::Clock::now();
+	ConnectionRegistry::Entry entry = m_Connections.Get(remote_endpoint);
+	if (!entry.m_Connection)
+	{
+		// The connection is opened by the next tick, retried cookies until then are dropped there
+		if (!AcceptCookie(data, size, remote_endpoint))
+		{
+			return;
+		}
 
-			for (const auto& msg : timeout_msgs)
+		if (m_Inbound.Reserve(1))
+		{
+			EnqueueReserved(remote_endpoint, 0, nullptr, 0, now);
+		}
+		else
+		{
+			DropIngress(IngressDrop::QueueFull, remote_endpoint);
+		}
+		return;
+	}
+
+	// Only the transport state is touched here, handlers run on the simulation thread
+	const Connection& client = *entry.m_Connection;
+	if (!client.m_Ingress->TakeDatagram(now))
+	{
+		DropIngress(IngressDrop::DatagramRate, remote_endpoint);
+		return;
+	}
+
+	// Every packet header carries acks for our reliable messages
+	uint16_t ack;
+	uint32_t ack_bits;
+	MessageBundle::ReadPacketHeader(data, ack, ack_bits);
+	client.m_Reliability->Acknowledge(ack, ack_bits);
+
+	// Every message handed out here was reserved room for before it was acknowledged
+	size_t reserved = 0;
+	auto handle = [this, &client, &remote_endpoint, now, &reserved](NetworkMessageReader& msg)
+	{
+		assert(reserved > 0 && "Handed out more messages than counted.");
+		reserved--;
+		EnqueueReserved(remote_endpoint, client.m_Id, msg.GetData(), msg.GetSize(), now);
+		return true;
+	};
+
+	// Split the bundle and queue each message on its own
+	size_t offset = NET_PACKET_HEADER_SIZE;
+	while (offset + NET_MSG_HEADER_SIZE <= size)
+	{
+		size_t length = (size_t)data[offset + 2] | (size_t)data[offset + 3] << 8;
+		if (offset + NET_MSG_HEADER_SIZE + length > size)
+		{
+			break;
+		}
+
+		const uint8_t* payload = data + offset + NET_MSG_HEADER_SIZE;
+		NetworkMessageReader msg(data + offset, NET_MSG_HEADER_SIZE + length, remote_endpoint);
+		offset += NET_MSG_HEADER_SIZE + length;
+
+		if (!IngressFilter::IsExpected(msg.GetType()))
+		{
+			DropIngress(IngressDrop::UnexpectedType, remote_endpoint);
+			continue;
+		}
+
+		// Dropped before it is marked received, so a reliable message over its limit is resent later
+		if (!client.m_Ingress->TakeMessage(msg.GetType(), now))
+		{
+			DropIngress(IngressDrop::MessageRate, remote_endpoint);
+			continue;
+		}
+
+		// Fragments go through the channel of the message they are part of
+		PacketType type = msg.GetType();
+		if (type == PacketType::Fragment && length >= sizeof(uint16_t))
+		{
+			type = (PacketType)(payload[0] | payload[1] << 8);
+		}
+
+		// Messages too far ahead of their ordered stream are not acknowledged so they get resent later
+		Admission admission = client.m_Channels->Admit(type, msg.GetChannelSequence());
+		if (admission == Admission::Refuse)
+		{
+			continue;
+		}
+
+		// Same for a simulation that fell so far behind the queue can not take this message and the held back
+		// ones it releases. Once acknowledged a message is never resent, so the room is reserved before
+		reserved = admission == Admission::Accept ? client.m_Channels->CountDeliveries(type, msg.GetChannelSequence()) : 0;
+		if (reserved > 0 && !m_Inbound.Reserve(reserved))
+		{
+			reserved = 0;
+			DropIngress(IngressDrop::QueueFull, remote_endpoint);
+			continue;
+		}
+
+		// Duplicated or stale datagrams are acknowledged again but never reach a handler twice
+		if (msg.GetSequenceId() > 0 && !client.m_Reliability->Received(msg.GetSequenceId()))
+		{
+			m_DuplicatesDiscarded++;
+		}
+		else if (admission == Admission::Accept && msg.GetType() == PacketType::Fragment)
+		{
+			// Handled like any other message once every fragment arrived
+			std::optional<NetworkMessageReader> message = client.m_Fragments->Add(msg, now);
+			if (message)
 			{
-				AckReceived(msg.first, msg.second);
+				m_MessagesReassembled++;
+				client.m_Channels->Deliver(*message, handle);
 			}
-			timeout_msgs.clear();
+		}
+		else if (admission == Admission::Accept)
+		{
+			client.m_Channels->Deliver(msg, handle);
+		}
+
+		// Room of fragments that did not complete a message and of messages that were not handed out
+		m_Inbound.Unreserve(reserved);
+		reserved = 0;
+	}
+}
+
+// Copy a message into room reserved in the inbound queue, a connection id of 0 with no message is a connect request.
+// Called by the receive threads
+void Network::EnqueueReserved(const asio::ip::udp::endpoint& remote_endpoint, uint32_t connection_id, const uint8_t* data, size_t size, RetransmitScheduler::Clock::time_point now)
+{
+	m_Inbound.PushReserved([&](InboundCommand& command)
+	{
+		command.m_Endpoint = remote_endpoint;
+		command.m_ConnectionId = connection_id;
+		command.m_ReceiveTime = now;
+		command.m_Message.assign(data, data + size);
+	});
+}
+
+// Run everything the receive threads queued since the last tick, the only place received traffic touches the ECS.
+// Commands queued while draining wait for the next tick so a flood can not stall the simulation
+void Network::ProcessInbound()
+{
+	RetransmitScheduler::Clock::time_point start = RetransmitScheduler::Clock::now();
+	size_t depth = m_Inbound.Size();
+	EntityManager* ecs = m_Game->GetECS();
+
+	size_t drained = 0;
+	InboundCommand* command = nullptr;
+	while (drained < depth && (command = m_Inbound.Front()) != nullptr)
+	{
+		drained++;
+		if (command->m_ConnectionId == 0)
+		{
+			OpenConnection(command->m_Endpoint);
+			m_Inbound.Pop();
+			continue;
+		}
+
+		// Queued for a connection that was closed since, maybe replaced by a new one on the same endpoint
+		ConnectionRegistry::Entry entry = m_Connections.Get(command->m_Endpoint);
+		if (!entry.m_Connection || entry.m_Connection->m_Id != command->m_ConnectionId)
+		{
+			m_InboundStale++;
+			m_Inbound.Pop();
+			continue;
+		}
+
+		Connection& client = ecs->GetComponent<Connection>(entry.m_Entity);
+		NetworkMessageReader msg(command->m_Message.data(), command->m_Message.size(), command->m_Endpoint);
+		msg.SetReceiveTime(command->m_ReceiveTime);
+		if (!client.m_Authorized && msg.GetType() != PacketType::HandShake && msg.GetType() != PacketType::Acknowledge)
+		{
+			TerminateClient(client);
 		}
 		else
 		{
-			Idle();
+			m_Rpc.Invoke(msg.GetType(), client, msg);
+		}
+		m_Inbound.Pop();
+	}
+
+	uint64_t elapsed = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(RetransmitScheduler::Clock::now() - start).count();
+	m_InboundDepth = depth;
+	m_InboundMaxDepth = std::max<uint64_t>(m_InboundMaxDepth, depth);
+	m_InboundDrained += drained;
+	m_InboundDrains++;
+	m_InboundDrainTime += elapsed;
+	m_InboundMaxDrainTime = std::max<uint64_t>(m_InboundMaxDrainTime, elapsed);
+}
+
+void Network::OpenConnection(const asio::ip::udp::endpoint& remote_endpoint)
+{
+	if (m_Connections.Find(remote_endpoint) < MAX_ENTITIES)
+	{
+		return;
+	}
+
+	EntityManager* ecs = m_Game->GetECS();
+	uint32_t peer_id = ++m_NewPeerId;	// TODO: Proper UUID generation
+	Entity entity = ecs->CreateEntity();
+	std::shared_ptr<ReliableWindow> reliability = std::make_shared<ReliableWindow>(remote_endpoint, m_Settings.m_SendRate, m_Settings.m_MaxSendRate);
+	Connection& client = ecs->AddComponent(entity, Connection{
+		.m_Id = peer_id,
+		.m_Endpoint = remote_endpoint,
+		.m_Authorized = false,
+		.m_PingTimer = 0.f,
+		.m_Reliability = reliability,
+		.m_Bundle = std::make_shared<MessageBundle>(reliability, m_Scheduler),
+		.m_Fragments = std::make_shared<FragmentAssembler>(),
+		.m_Channels = std::make_shared<ChannelState>(),
+		.m_Ingress = std::make_shared<IngressLimiter>()
+	});
+	m_Connections.Add(remote_endpoint, entity, client);
+
+	NetworkMessage msg = MakeMessage(ServerHandShake{ client.m_Id, RoundtripEstimator::ToTimestamp(RetransmitScheduler::Clock::now()) }, client.m_Endpoint);
+	Send(msg);
+
+	std::cout << "New Connection | " << client.m_Endpoint << " | id: " << client.m_Id << std::endl;
+}
+
+// Endpoints without a connection have to echo a cookie before anything is allocated for them. The first HandShake
+// is answered with a Challenge holding a cookie, the next one carrying it opens the connection.
+// Anything else is dropped without a reply
+bool Network::AcceptCookie(const uint8_t* data, size_t size, const asio::ip::udp::endpoint& remote_endpoint)
+{
+	if (size != NET_PACKET_HEADER_SIZE + NET_MSG_HEADER_SIZE + COOKIE_SIZE)
+	{
+		m_UnknownDropped++;
+		return false;
+	}
+
+	const uint8_t* header = data + NET_PACKET_HEADER_SIZE;
+	const uint8_t* cookie = header + NET_MSG_HEADER_SIZE;
+	PacketType type = (PacketType)(header[0] | header[1] << 8);
+	size_t length = (size_t)header[2] | (size_t)header[3] << 8;
+	if (type != PacketType::HandShake || length != COOKIE_SIZE)
+	{
+		m_UnknownDropped++;
+		return false;
+	}
+
+	// Both answering with a Challenge and checking a cookie cost a MAC, a flood of either is cut off here
+	RetransmitScheduler::Clock::time_point now = RetransmitScheduler::Clock::now();
+	if (!m_Ingress.TakeHandshake(remote_endpoint, now))
+	{
+		DropIngress(IngressDrop::HandshakeRate, remote_endpoint);
+		return false;
+	}
+
+	if (ConnectCookie::IsEmpty(cookie))
+	{
+		ServerChallenge packet;
+		m_Cookies.Issue(remote_endpoint, now, packet.m_Cookie.data());
+		NetworkMessage challenge = MakeMessage(packet, remote_endpoint);
+		Send(challenge);
+		m_ChallengesSent++;
+		return false;
+	}
+
+	if (!m_Cookies.Verify(remote_endpoint, cookie, now))
+	{
+		m_CookiesRejected++;
+		return false;
+	}
+
+	return true;
+}
+
+void Network::DropIngress(IngressDrop reason, const asio::ip::udp::endpoint& remote_endpoint)
+{
+	m_Ingress.Drop(reason);
+	if (m_IngressLog.Allow())
+	{
+		std::cout << "[Ingress] Dropped " << GetIngressDropName(reason) << " from " << remote_endpoint << std::endl;
+	}
+}
+
+void Network::Transmit(const DatagramBuffers& buffers, const asio::ip::udp::endpoint& remote_endpoint)
+{
+	Shard& shard = GetShard(remote_endpoint);
+	if (!IsBatchedIO() && !IsUringIO())
+	{
+		shard.m_Socket.send_to(buffers, remote_endpoint);
+		shard.m_SendCalls++;
+		shard.m_PacketsSent++;
+		return;
+	}
+
+	shard.m_SendMutex.lock();
+	if (shard.m_SendQueueSize == shard.m_SendQueue.size())
+	{
+		shard.m_SendQueue.emplace_back();
+	}
+
+	// Gather into a reused slot so its buffer capacity survives between flushes,
+	// the shared payloads may be released before the queue is flushed
+	Datagram& datagram = shard.m_SendQueue[shard.m_SendQueueSize++];
+	datagram.m_Endpoint = remote_endpoint;
+	datagram.m_Data.clear();
+	for (const asio::const_buffer& buffer : buffers)
+	{
+		const uint8_t* data = (const uint8_t*)buffer.data();
+		datagram.m_Data.insert(datagram.m_Data.end(), data, data + buffer.size());
+	}
+
+	if (shard.m_SendQueueSize >= m_Settings.m_BatchSize)
+	{
+		FlushSendQueue(shard);
+	}
+	shard.m_SendMutex.unlock();
+}
+
+// End of a tick, everything sent during it is bundled and sent on the sender thread
+void Network::Flush()
+{
+	if (!m_Settings.m_SendThread)
+	{
+		FlushBundles();
+		return;
+	}
+
+	PushOutbound([](OutboundCommand& command)
+	{
+		command.m_Flush = true;
+	});
+	size_t depth = m_Outbound.Size();
+	m_OutboundDepth = depth;
+	m_OutboundMaxDepth = std::max<uint64_t>(m_OutboundMaxDepth, depth);
+	WakeSender();
+}
+
+void Network::FlushBundles()
+{
+	// Close every bundle that got messages since the last flush
+	m_BundleMutex.lock();
+	m_FlushBundles.swap(m_PendingBundles);
+	m_BundleMutex.unlock();
+
+	for (std::shared_ptr<MessageBundle>& bundle : m_FlushBundles)
+	{
+		const asio::ip::udp::endpoint& endpoint = bundle->GetEndpoint();
+		bool held_back = bundle->Flush([this, &endpoint](const DatagramBuffers& buffers)
+		{
+			Transmit(buffers, endpoint);
+		});
+
+		// Reliable messages over the send budget are tried again next flush
+		if (held_back)
+		{
+			m_BundleMutex.lock();
+			m_PendingBundles.push_back(bundle);
+			m_BundleMutex.unlock();
 		}
 	}
+	m_FlushBundles.clear();
+
+	FlushSendQueues();
 }
 
-void Network::Handle(const std::vector<uint8_t>& data, const asio::ip::udp::endpoint& remote_endpoint)
+void Network::FlushSendQueues()
 {
-	if (EntityManager* ecs = m_Game->GetECS())
+	if (!IsBatchedIO() && !IsUringIO())
 	{
-		Entity entity = ecs->GetEntityFromEndpoint(remote_endpoint);
-		if (entity <= MAX_ENTITIES)
+		return;
+	}
+
+	for (std::unique_ptr<Shard>& shard : m_Shards)
+	{
+		shard->m_SendMutex.lock();
+		FlushSendQueue(*shard);
+		shard->m_SendMutex.unlock();
+	}
+}
+
+// Expects shard.m_SendMutex to be held by the caller
+void Network::FlushSendQueue(Shard& shard)
+{
+#ifdef NET_HAS_BATCHED_IO
+	if (shard.m_SendQueueSize == 0)
+	{
+		return;
+	}
+
+	shard.m_SendHeaders.resize(shard.m_SendQueueSize);
+	shard.m_SendIov.resize(shard.m_SendQueueSize);
+	for (size_t i = 0; i < shard.m_SendQueueSize; ++i)
+	{
+		Datagram& datagram = shard.m_SendQueue[i];
+		shard.m_SendIov[i].iov_base = datagram.m_Data.data();
+		shard.m_SendIov[i].iov_len = datagram.m_Data.size();
+		shard.m_SendHeaders[i].msg_hdr = {};
+		shard.m_SendHeaders[i].msg_hdr.msg_name = datagram.m_Endpoint.data();
+		shard.m_SendHeaders[i].msg_hdr.msg_namelen = (socklen_t)datagram.m_Endpoint.size();
+		shard.m_SendHeaders[i].msg_hdr.msg_iov = &shard.m_SendIov[i];
+		shard.m_SendHeaders[i].msg_hdr.msg_iovlen = 1;
+		shard.m_SendHeaders[i].msg_len = 0;
+	}
+
+	size_t count = shard.m_SendQueueSize;
+#ifdef NET_HAS_IO_URING
+	if (shard.m_SendRing)
+	{
+		int error = 0;
+		size_t calls = 0;
+		bool submitted = shard.m_SendRing->Send(shard.m_SendHeaders.data(), count, calls, error);
+		shard.m_SendCalls += calls;
+
+		// Move whatever the ring did not get out to the front for sendmmsg
+		count = 0;
+		for (size_t i = 0; i < shard.m_SendQueueSize; ++i)
 		{
-			NetworkMessage msg(data);
-			msg.SetEndpoint(remote_endpoint);
-			Connection& client = ecs->GetComponent<Connection>(entity);
-			if (client.m_Authorized)
+			if (shard.m_SendHeaders[i].msg_len > 0)
 			{
-				m_Rpc.Invoke(msg.GetType(), client, msg);
+				shard.m_PacketsSent++;
 			}
-			else
+			else if (!submitted)
 			{
-				//std::cout << "Recv type: " << (int)msg.GetType() << " Sequence: " << msg.GetSequenceId() << std::endl;
-				if (msg.GetType() == PacketType::HandShake || msg.GetType() == PacketType::Acknowledge)
-				{
-					m_Rpc.Invoke(msg.GetType(), client, msg);
-				}
-				else
-				{
-					TerminateClient(client);
-				}
+				shard.m_SendHeaders[count++] = shard.m_SendHeaders[i];
 			}
 		}
-		else
+
+		if (submitted)
 		{
-			// No entity with this endpoint exists lets create one
-			uint32_t peer_id = ++m_NewPeerId;	// TODO: Proper UUID generation
-			Connection& client = ecs->AddComponent(ecs->CreateEntity(), Connection{ peer_id, remote_endpoint });
+			if (error != 0 && m_Game->IsRunning())
+			{
+				std::cout << "\nException: io_uring send failed with errno " << error << "\n" << std::endl;
+			}
+			shard.m_SendQueueSize = 0;
+			return;
+		}
 
-			NetworkMessage msg(PacketType::HandShake, client.m_Endpoint, true);
-			msg.Write(client.m_Id);
-			msg.Write(m_Game->GetElapsedTime());
-			Send(msg);
+		// Its queued entries can never be taken back, this shard sends with sendmmsg from now on
+		std::cout << "[Network] io_uring send ring failed: " << strerror(error) << ", falling back to sendmmsg" << std::endl;
+		shard.m_SendRing.reset();
+	}
+#endif
 
-			std::cout << "New Connection | " << client.m_Endpoint << " | id: " << client.m_Id << std::endl;
+	int socket = shard.m_Socket.native_handle();
+	size_t sent = 0;
+	while (sent < count)
+	{
+		int result = sendmmsg(socket, &shard.m_SendHeaders[sent], (unsigned int)(count - sent), 0);
+		if (result < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			// Skip the datagram that failed and keep flushing the rest
+			if (m_Game->IsRunning())
+			{
+				std::cout << "\nException: sendmmsg failed with errno " << errno << "\n" << std::endl;
+			}
+			sent++;
+			continue;
 		}
+
+		shard.m_SendCalls++;
+		shard.m_PacketsSent += result;
+		sent += result;
 	}
+
+	shard.m_SendQueueSize = 0;
+#endif
 }
 
-void Network::AckReceived(uint32_t sequence_id, const asio::ip::udp::endpoint& remote_endpoint)
+// Outgoing traffic is spread over the shard sockets, any socket bound to the port can reach any client
+Network::Shard& Network::GetShard(const asio::ip::udp::endpoint& remote_endpoint)
 {
-	m_DispatchMutex.lock();
-	std::vector<NetworkMessage>::iterator itr = std::find_if(m_DispatchList.begin(), m_DispatchList.end(), 
-		[sequence_id, remote_endpoint](NetworkMessage& msg)
-		{ 
-			return msg.GetSequenceId() == sequence_id && msg.GetEndpoint() == remote_endpoint;
-		});
+	if (m_Shards.size() == 1)
+	{
+		return *m_Shards[0];
+	}
+
+	return *m_Shards[EndpointHash()(remote_endpoint) % m_Shards.size()];
+}
 
-	if (itr != m_DispatchList.end())
+bool Network::IsBatchedIO()
+{
+#ifdef NET_HAS_BATCHED_IO
+	return m_Settings.m_BatchedIO && m_Settings.m_BatchSize > 0;
+#else
+	return false;
+#endif
+}
+
+void Network::PrintStats()
+{
+	uint64_t total_received = 0;
+	uint64_t total_sent = 0;
+
+	std::cout << "[Network] Batched I/O: " << (IsBatchedIO() ? "on" : "off") << " | io_uring: " << (IsUringIO() ? "on" : "off");
+	std::cout << " | Shards: " << m_Shards.size() << std::endl;
+	for (std::unique_ptr<Shard>& shard : m_Shards)
 	{
-		m_DispatchList.erase(itr);
+		uint64_t received = shard->m_PacketsReceived;
+		uint64_t receive_calls = shard->m_ReceiveCalls;
+		uint64_t sent = shard->m_PacketsSent;
+		uint64_t send_calls = shard->m_SendCalls;
+		total_received += received;
+		total_sent += sent;
+
+		std::cout << "\tShard " << shard->m_Index << " | Received: " << received << " packets in " << receive_calls << " syscalls";
+		std::cout << " (" << (receive_calls > 0 ? (double)received / receive_calls : 0.0) << " per call)";
+		std::cout << " | Sent: " << sent << " packets in " << send_calls << " syscalls";
+		std::cout << " (" << (send_calls > 0 ? (double)sent / send_calls : 0.0) << " per call)";
+#ifdef NET_HAS_IO_URING
+		if (shard->m_ReceiveRing)
+		{
+			std::cout << " | Truncated: " << shard->m_ReceiveRing->GetTruncated();
+		}
+#endif
+		std::cout << std::endl;
 	}
-	m_DispatchMutex.unlock();
+	std::cout << "\tTotal | Received: " << total_received << " packets | Sent: " << total_sent << " packets" << std::endl;
+	std::cout << "\tReliable | Scheduled: " << m_Scheduler.Size() << " | Retransmissions: " << m_Retransmissions << std::endl;
+	std::cout << "\tHandshake | Challenges sent: " << m_ChallengesSent << " | Cookies rejected: " << m_CookiesRejected;
+	std::cout << " | Unknown endpoint packets dropped: " << m_UnknownDropped << std::endl;
+	std::cout << "\tIngress | Malformed: " << m_Ingress.GetDropped(IngressDrop::Malformed);
+	std::cout << " | Unexpected type: " << m_Ingress.GetDropped(IngressDrop::UnexpectedType);
+	std::cout << " | Datagram rate: " << m_Ingress.GetDropped(IngressDrop::DatagramRate);
+	std::cout << " | Message rate: " << m_Ingress.GetDropped(IngressDrop::MessageRate);
+	std::cout << " | Handshake rate: " << m_Ingress.GetDropped(IngressDrop::HandshakeRate);
+	std::cout << " | Queue full: " << m_Ingress.GetDropped(IngressDrop::QueueFull) << std::endl;
+	uint64_t drains = m_InboundDrains;
+	std::cout << "\tInbound | Depth: " << m_InboundDepth << " (max " << m_InboundMaxDepth << " of " << m_Inbound.Capacity() << ")";
+	std::cout << " | Drained: " << m_InboundDrained << " | Stale: " << m_InboundStale;
+	std::cout << " | Drain time: " << (drains > 0 ? m_InboundDrainTime / drains / 1000.0 : 0.0) << " us (max " << m_InboundMaxDrainTime / 1000.0 << " us)" << std::endl;
+	std::cout << "\tOutbound | Sender thread: " << (m_Settings.m_SendThread ? "on" : "off");
+	std::cout << " | Depth: " << m_OutboundDepth << " (max " << m_OutboundMaxDepth << " of " << m_Outbound.Capacity() << ") | Stalls: " << m_OutboundStalls;
+	std::cout << " | Send time: " << m_SendTimes.GetAverage() << " us (p99 <= " << m_SendTimes.GetPercentile(0.99) << " us, max " << m_SendTimes.GetMax() << " us)" << std::endl;
+	std::cout << "\tMessages | Sent: " << m_MessagesSent << " | Payloads serialized: " << m_PayloadsSerialized;
+	std::cout << " | Duplicates discarded: " << m_DuplicatesDiscarded << std::endl;
+
+	uint64_t fragments_dropped = 0;
+	uint64_t connections = 0;
+	uint64_t send_rate = 0;
+	uint64_t budget_dropped = 0;
+	uint64_t budget_held_back = 0;
+	uint64_t retransmits_held_back = 0;
+	RetransmitScheduler::Clock::duration roundtrip_time{};
+	RetransmitScheduler::Clock::duration roundtrip_variation{};
+	uint64_t acked = 0;
+	uint64_t lost = 0;
+	uint64_t given_up = 0;
+	m_Connections.ForEach([&](Entity /*entity*/, const Connection& client)
+	{
+		fragments_dropped += client.m_Fragments->GetDropped();
+		connections++;
+		send_rate += client.m_Reliability->GetSendRate();
+		budget_dropped += client.m_Bundle->GetDropped();
+		budget_held_back += client.m_Bundle->GetHeldBack();
+		retransmits_held_back += client.m_Reliability->GetHeldBackRetransmits();
+		roundtrip_time += client.m_Reliability->GetRoundtripTime();
+		roundtrip_variation += client.m_Reliability->GetRoundtripVariation();
+		acked += client.m_Reliability->GetAcked();
+		lost += client.m_Reliability->GetLost();
+		given_up += client.m_Reliability->GetGivenUp();
+	});
+	std::cout << "\tFragments | Messages split: " << m_MessagesFragmented << " | Fragments sent: " << m_FragmentsSent;
+	std::cout << " | Reassembled: " << m_MessagesReassembled << " | Dropped incomplete: " << fragments_dropped << std::endl;
+	std::cout << "\tSend budget | Avg rate: " << (connections > 0 ? send_rate / connections / 1024 : 0) << " KB/s";
+	std::cout << " | Dropped: " << budget_dropped << " | Held back: " << budget_held_back << " | Retransmits held back: " << retransmits_held_back << std::endl;
+	std::cout << "\tRoundtrip | Avg RTT: " << (connections > 0 ? ToMilliseconds(roundtrip_time) / connections : 0.0) << " ms";
+	std::cout << " | Avg jitter: " << (connections > 0 ? ToMilliseconds(roundtrip_variation) / connections : 0.0) << " ms";
+	std::cout << " | Loss: " << (acked + lost > 0 ? 100.0 * lost / (acked + lost) : 0.0) << "% | Given up: " << given_up << std::endl;
+
+	BufferPool& pool = BufferPool::Get();
+	std::cout << "\tBuffer pool | Hits: " << pool.GetHits() << " | Misses: " << pool.GetMisses();
+	std::cout << " | In use: " << pool.GetInUse() << " | High-water: " << pool.GetHighWater() << " | Shrunk: " << pool.GetShrunk() << std::endl;
 }
 
-void Network::Idle()
+// One line per connection, jitter is the smoothed deviation of the roundtrip samples
+void Network::PrintConnections()
 {
-	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	std::cout << "[Network] Connections: " << m_Connections.Size() << std::endl;
+	m_Connections.ForEach([&](Entity /*entity*/, const Connection& client)
+	{
+		ReliableWindow& window = *client.m_Reliability;
+		uint64_t sent = window.GetAcked() + window.GetLost();
+		std::cout << "\t" << client.m_Endpoint << " | id: " << client.m_Id;
+		std::cout << " | RTT: " << ToMilliseconds(window.GetRoundtripTime()) << " ms | Jitter: " << ToMilliseconds(window.GetRoundtripVariation()) << " ms";
+		std::cout << " | RTO: " << ToMilliseconds(window.GetRetransmitTimeout()) << " ms";
+		std::cout << " | Loss: " << (sent > 0 ? 100.0 * window.GetLost() / sent : 0.0) << "% | Given up: " << window.GetGivenUp();
+		std::cout << " | Send rate: " << window.GetSendRate() / 1024 << " KB/s" << std::endl;
+	});
 }
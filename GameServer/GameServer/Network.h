@@ -1,42 +1,193 @@
 #pragma once
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include "RpcManager.h"
+#include "ConnectionRegistry.h"
+#include "ReliableWindow.h"
+#include "MessageBundle.h"
+#include "FragmentAssembler.h"
+#include "ChannelState.h"
+#include "ConnectCookie.h"
+#include "IngressFilter.h"
+#include "RateLimitedLog.h"
+#include "MpscQueue.h"
+#include "DurationHistogram.h"
+
+#if defined(__linux__)
+#define NET_HAS_BATCHED_IO
+#define NET_HAS_REUSEPORT
+#include <sys/socket.h>
+#if __has_include(<linux/io_uring.h>)
+#define NET_HAS_IO_URING
+#include "IoUring.h"
+#endif
+#endif
+
+struct NetworkSettings
+{
+	bool m_BatchedIO = true;		// Drain and flush datagrams with recvmmsg/sendmmsg (Linux only)
+	uint16_t m_BatchSize = 32;		// Max amount of datagrams per batched syscall
+	bool m_IoUring = false;			// Receive and send through io_uring, falls back to the settings above when the kernel lacks it (Linux only)
+	uint16_t m_ReceiveShards = 1;	// Sockets bound to the same port with SO_REUSEPORT, one receive thread each (Linux only)
+	bool m_SendThread = true;		// Bundle and send outgoing messages on a thread of their own instead of within the simulation tick
+	bool m_Snapshots = true;		// Replicate movement with delta compressed snapshots instead of Movement broadcasts
+	uint16_t m_ViewRadius = 32;		// Tiles around a player within which other players are replicated to it
+	uint32_t m_SendRate = 128 * 1024;		// Bytes per second a new connection may be sent before congestion control adjusts it
+	uint32_t m_MaxSendRate = 1024 * 1024;	// Bytes per second congestion control never raises a connection above
+};
+
+const size_t INBOUND_QUEUE_CAPACITY = 8192;	// Received messages that can wait for the next tick, a power of two
+const size_t OUTBOUND_QUEUE_CAPACITY = 32768;	// Outgoing messages the simulation can get ahead of the sender thread, a power of two
 
 class Game;
+struct VisibleEntity;
 class Network
 {
 public:
-	Network(Game* game, uint16_t port) : m_Game(game), m_Socket(m_Context, asio::ip::udp::endpoint(asio::ip::udp::v4(), port)), m_Rpc(this), m_NewPeerId(0), m_ReceiveBuffer(NET_MSG_MAX_SIZE) {}
+	Network(Game* game, uint16_t port, const NetworkSettings& settings);
 	~Network();
 
-	const uint16_t NET_MSG_MAX_SIZE = 65507;
+	const uint16_t NET_MSG_MAX_SIZE = 65507;	// Largest datagram we can receive, larger messages are sent in fragments
 
 	void Start();
 	void Shutdown();
 	void Send(NetworkMessage& msg);
 	void SendToAll(NetworkMessage& msg, Connection* ignore = nullptr);
+	void SendToObservers(NetworkMessage& msg, const std::vector<VisibleEntity>& observers);
+	void SendTracked(NetworkMessage& msg, const Connection& client, uint32_t tag);
+	void Flush();
+	void ProcessInbound();
 	void TerminateClient(const Connection& client);
 	Game* GetGameInstance() { return m_Game; }
-	void AckReceived(uint32_t sequence_id, const asio::ip::udp::endpoint& remote_endpoint);
+	const NetworkSettings& GetSettings() { return m_Settings; }
+	ConnectionRegistry& GetConnections() { return m_Connections; }
+	bool IsBatchedIO();
+	bool IsUringIO() { return m_UringIO; }
+	void PrintStats();
+	void PrintConnections();
 
 private:
 	Game* m_Game = nullptr;
+	NetworkSettings m_Settings;
 	asio::io_context m_Context;
-	asio::ip::udp::socket m_Socket;
-	std::thread m_Listener;
 	std::thread m_Dispatcher;
-	std::vector<NetworkMessage> m_DispatchList;
-	std::mutex m_DispatchMutex;
+	RetransmitScheduler m_Scheduler;
+	std::atomic<uint64_t> m_Retransmissions{};
+	std::atomic<uint64_t> m_MessagesSent{};
+	std::atomic<uint64_t> m_PayloadsSerialized{};
+	std::atomic<uint64_t> m_MessagesFragmented{};
+	std::atomic<uint64_t> m_FragmentsSent{};
+	std::atomic<uint64_t> m_MessagesReassembled{};
+	std::atomic<uint64_t> m_DuplicatesDiscarded{};
+	std::atomic<uint64_t> m_ChallengesSent{};
+	std::atomic<uint64_t> m_CookiesRejected{};
+	std::atomic<uint64_t> m_UnknownDropped{};
+	std::vector<std::shared_ptr<MessageBundle>> m_PendingBundles;
+	std::vector<std::shared_ptr<MessageBundle>> m_FlushBundles;
+	std::mutex m_BundleMutex;
 	RpcManager m_Rpc;
-	void Listen();
-	void Dispatch();
-	void Handle(const std::vector<uint8_t>& data, const asio::ip::udp::endpoint& remote_endpoint);
-	void Idle();
-	uint32_t m_NewPeerId = 0;
+	ConnectionRegistry m_Connections;
+	ConnectCookie m_Cookies;
+	IngressFilter m_Ingress;
+	RateLimitedLog m_IngressLog{ 5 };
 
-	asio::ip::udp::endpoint m_RemoteEndpoint;
-	std::vector<uint8_t> m_ReceiveBuffer;
-	size_t m_ReceivedSize = 0;
-};
+	// Decoded message of a connection, or a connect request that passed the cookie check, waiting for the next tick
+	struct InboundCommand
+	{
+		asio::ip::udp::endpoint m_Endpoint;
+		uint32_t m_ConnectionId = 0;	// Connection the message arrived on, 0 for a connect request
+		RetransmitScheduler::Clock::time_point m_ReceiveTime;
+		std::vector<uint8_t> m_Message;	// Header included, the capacity stays with the queue slot
+	};
+	MpscQueue<InboundCommand> m_Inbound{ INBOUND_QUEUE_CAPACITY };
+	std::atomic<uint64_t> m_InboundDepth{};
+	std::atomic<uint64_t> m_InboundMaxDepth{};
+	std::atomic<uint64_t> m_InboundDrained{};
+	std::atomic<uint64_t> m_InboundStale{};
+	std::atomic<uint64_t> m_InboundDrains{};
+	std::atomic<uint64_t> m_InboundDrainTime{};		// Nanoseconds
+	std::atomic<uint64_t> m_InboundMaxDrainTime{};	// Nanoseconds
+
+	// Message the simulation handed to the sender thread, or the end of a tick
+	struct OutboundCommand
+	{
+		bool m_Flush = false;	// Close every bundle, nothing else is set
+		Connection m_Client{};	// Copy of the recipient sharing its transport state, keeps it alive after a disconnect
+		PacketType m_Type = PacketType::Disconnect;
+		SharedPayload m_Payload;
+		uint32_t m_Tag = 0;
+	};
+	MpscQueue<OutboundCommand> m_Outbound{ OUTBOUND_QUEUE_CAPACITY };
+	std::thread m_Sender;
+	std::atomic<uint64_t> m_SenderWakeups{};	// Bumped to wake up the sender thread
+	std::atomic<bool> m_SenderStop{};
+	std::atomic<uint64_t> m_OutboundDepth{};
+	std::atomic<uint64_t> m_OutboundMaxDepth{};
+	std::atomic<uint64_t> m_OutboundStalls{};
+	DurationHistogram m_SendTimes;	// Sender thread time per tick
+	bool m_UringIO = false;
 
+	// Outgoing datagrams waiting for the next batched flush
+	struct Datagram
+	{
+		asio::ip::udp::endpoint m_Endpoint;
+		std::vector<uint8_t> m_Data;
+	};
+
+	// One socket bound to the listen port and the thread receiving on it
+	struct Shard
+	{
+		Shard(asio::io_context& context, size_t index) : m_Index(index), m_Socket(context) {}
+
+		size_t m_Index;
+		asio::ip::udp::socket m_Socket;
+		std::thread m_Listener;
+		asio::ip::udp::endpoint m_RemoteEndpoint;
+		std::vector<uint8_t> m_ReceiveBuffer;
+		size_t m_ReceivedSize = 0;
+
+		std::vector<Datagram> m_SendQueue;
+		size_t m_SendQueueSize = 0;
+		std::mutex m_SendMutex;
+#ifdef NET_HAS_BATCHED_IO
+		std::vector<mmsghdr> m_SendHeaders;
+		std::vector<iovec> m_SendIov;
+#endif
+#ifdef NET_HAS_IO_URING
+		std::unique_ptr<UdpReceiveRing> m_ReceiveRing;
+		std::unique_ptr<UdpSendRing> m_SendRing;
+#endif
+
+		// Statistics
+		std::atomic<uint64_t> m_PacketsReceived{};
+		std::atomic<uint64_t> m_PacketsSent{};
+		std::atomic<uint64_t> m_ReceiveCalls{};
+		std::atomic<uint64_t> m_SendCalls{};
+	};
+	std::vector<std::unique_ptr<Shard>> m_Shards;
+
+	void Listen(Shard& shard);
+	void ListenBatched(Shard& shard);
+	void ListenUring(Shard& shard);
+	void Dispatch();
+	void SendOutbound();
+	void Handle(const uint8_t* data, size_t size, const asio::ip::udp::endpoint& remote_endpoint);
+	bool AcceptCookie(const uint8_t* data, size_t size, const asio::ip::udp::endpoint& remote_endpoint);
+	void EnqueueReserved(const asio::ip::udp::endpoint& remote_endpoint, uint32_t connection_id, const uint8_t* data, size_t size, RetransmitScheduler::Clock::time_point now);
+	void OpenConnection(const asio::ip::udp::endpoint& remote_endpoint);
+	void DropIngress(IngressDrop reason, const asio::ip::udp::endpoint& remote_endpoint);
+	void Post(PacketType type, const SharedPayload& payload, const Connection& client, uint32_t tag = 0);
+	template<typename Fill>
+	void PushOutbound(Fill fill);
+	void WakeSender();
+	void SendTo(PacketType type, const SharedPayload& payload, const Connection& client, uint32_t tag = 0);
+	void SendFragments(PacketType type, uint16_t channel_sequence, const SharedPayload& payload, const Connection& client, uint32_t tag);
+	void Append(PacketType type, const SharedPayload& payload, uint16_t sequence_id, uint16_t channel_sequence, bool reliable, const Connection& client);
+	void Transmit(const DatagramBuffers& buffers, const asio::ip::udp::endpoint& remote_endpoint);
+	void FlushBundles();
+	void FlushSendQueues();
+	void FlushSendQueue(Shard& shard);
+	Shard& GetShard(const asio::ip::udp::endpoint& remote_endpoint);
+	std::atomic<uint32_t> m_NewPeerId{};
+};
@@ -1,6 +1,11 @@
 #pragma once
 #include <iostream>
 #include <vector>
+#include <span>
+#include <bit>
+#include <cstring>
+#include <type_traits>
+#include "BufferPool.h"
 #include "VectorMath.h"
 #include "ECS/Components/Connection.h"
 
@@ -10,6 +15,7 @@ enum class PacketType : uint16_t
 	HandShake,
 	Acknowledge,
 	Ping,
+	Challenge,	// Cookie sent to an endpoint without a connection in reply to its HandShake, see ConnectCookie
 	Notify,
 	Message,
 	PlayerData,
@@ -19,68 +25,154 @@ enum class PacketType : uint16_t
 	MapSector,
 	MapData,
 	UnloadMapData,
+	Snapshot,
+	Fragment,	// Piece of a message too large for a datagram, see FragmentAssembler. Has to stay after every regular type
 	MAX_SIZE	// This need to be last
 };
 
-static uint32_t s_SequenceCounter;
-const uint8_t MAX_MSG_TIMEOUTS = 32;	// Max amount of nack's before msg is timedout
+// Datagram: packet header followed by one or more messages, see MessageBundle
+// Packet header: latest received sequence id (uint16), ack bitfield (uint32)
+// Message header: packet type (uint16), payload length (uint16), sequence id (uint16), channel sequence (uint16)
+const size_t NET_PACKET_HEADER_SIZE = 6;
+const size_t NET_MSG_HEADER_SIZE = 8;
+
+// Sequence ids and channel sequences wrap around, lhs is newer if it is less than half the range ahead of rhs
+inline bool IsSequenceNewer(uint16_t lhs, uint16_t rhs)
+{
+	return lhs != rhs && (uint16_t)(lhs - rhs) < 0x8000;
+}
+
+// Sequence following the given one, 0 is skipped since it marks a message sent without one
+inline uint16_t NextSequenceId(uint16_t sequence)
+{
+	return sequence == UINT16_MAX ? 1 : sequence + 1;
+}
+
+// Serialized payload of a message in a pooled buffer, shared by every recipient and pending retransmission of it
+using SharedPayload = BufferRef;
+// Scatter/gather buffers making up one outgoing datagram
+using DatagramBuffers = std::vector<asio::const_buffer>;
+
+static_assert(std::endian::native == std::endian::little, "Messages are serialized by copying little-endian memory.");
+
+// Pool size class for the payload of a packet type
+inline BufferClass GetBufferClass(PacketType type)
+{
+	switch (type)
+	{
+	case PacketType::Notify:
+	case PacketType::Message:
+		return BufferClass::Medium;
+	case PacketType::MapSector:
+	case PacketType::MapData:
+	case PacketType::Snapshot:
+	case PacketType::Fragment:
+		return BufferClass::Large;
+	default:
+		return BufferClass::Small;
+	}
+}
+
+// Delivery guarantees of a message, picked per packet type
+enum class Channel : uint8_t
+{
+	Unreliable,				// Fire and forget
+	UnreliableSequenced,	// Fire and forget, anything older than the latest received of its stream is dropped
+	ReliableUnordered,		// Resent until acknowledged, handled as soon as it arrives
+	ReliableOrdered			// Resent until acknowledged, handled in the order it was sent within its stream
+};
+
+// Independent streams of sequenced and ordered messages per connection, a message only waits for or supersedes
+// messages of its own stream so map streaming can not hold up chat
+enum class Stream : uint8_t
+{
+	Session,
+	Entities,
+	Chat,
+	Map,
+	Snapshot,
+	MAX_SIZE	// This need to be last
+};
+
+struct ChannelInfo
+{
+	Channel m_Channel;
+	Stream m_Stream;
+
+	bool IsReliable() const { return m_Channel == Channel::ReliableUnordered || m_Channel == Channel::ReliableOrdered; }
+	bool IsSequenced() const { return m_Channel == Channel::UnreliableSequenced || m_Channel == Channel::ReliableOrdered; }
+};
+
+// Channel and stream of a packet type, both ends have to agree on these
+inline ChannelInfo GetChannel(PacketType type)
+{
+	switch (type)
+	{
+	case PacketType::Disconnect:
+	case PacketType::HandShake:
+		return { Channel::ReliableOrdered, Stream::Session };
+	case PacketType::PlayerData:
+	case PacketType::RemoveCreature:
+		return { Channel::ReliableOrdered, Stream::Entities };
+	case PacketType::Notify:
+		return { Channel::ReliableUnordered, Stream::Session };
+	case PacketType::Message:
+		return { Channel::ReliableOrdered, Stream::Chat };
+	case PacketType::MapSector:
+	case PacketType::MapData:
+	case PacketType::UnloadMapData:
+		return { Channel::ReliableOrdered, Stream::Map };
+	case PacketType::Movement:
+	case PacketType::Rotation:
+		// Updates of different entities share a connection, sequencing them per connection would let one entity's
+		// update drop another's. Receivers tell stale ones apart per entity by the tick in the payload
+		return { Channel::Unreliable, Stream::Session };
+	case PacketType::Snapshot:
+		return { Channel::UnreliableSequenced, Stream::Snapshot };
+	default:
+		return { Channel::Unreliable, Stream::Session };
+	}
+}
 
 class NetworkMessage
 {
 private:
 	asio::ip::udp::endpoint m_Endpoint;
-	std::vector<uint8_t> m_Data{};
+	SharedPayload m_Payload;
 	PacketType m_Type;
-	uint32_t m_SequenceId = 0;
 	size_t m_Size = 0;
-	size_t m_Index = 0;
-	uint64_t m_DispatchTimestamp = 0;
-	uint8_t m_SendTimeout = 0;
 
 public:
 
-	// Construct NetworkMessage of a given type
-	NetworkMessage(const PacketType& type, const asio::ip::udp::endpoint& receiver_endpoint, bool reliable = false) : m_Type(type), m_Endpoint(receiver_endpoint)
+	// Construct NetworkMessage of a given type, the header is written per connection when sent.
+	// How it is delivered follows from its type, see GetChannel
+	NetworkMessage(const PacketType& type, const asio::ip::udp::endpoint& receiver_endpoint) : m_Type(type), m_Endpoint(receiver_endpoint)
 	{
-		if (s_SequenceCounter == UINT32_MAX)
-		{
-			s_SequenceCounter = 0;
-			std::cout << "Reached max sequence id size, reseting" << std::endl;
-		}
-
-		if (reliable)
-		{
-			m_SequenceId = ++s_SequenceCounter;
-		}
-		Write(m_SequenceId);
-
-		// Add header to body
-		Write((uint16_t)type);
+		m_Payload = BufferPool::Get().Acquire(GetBufferClass(type));
+		m_Size = NET_MSG_HEADER_SIZE;
 	}
 
-	// Construct NetworkMessage from received data
-	NetworkMessage(const std::vector<uint8_t>& data) : m_Size(data.size())
+	// Write a message header for a payload of the given length into header (NET_MSG_HEADER_SIZE bytes)
+	static void WriteHeader(uint8_t* header, PacketType type, size_t length, uint16_t sequence_id, uint16_t channel_sequence)
 	{
-		// Copy data to this network message
-		m_Data.reserve(m_Size);
-		for (size_t i = 0; i < m_Size; ++i)
+		for (size_t i = 0; i < sizeof(uint16_t); ++i)
 		{
-			m_Data.push_back(data[i]);
+			header[i] = (uint8_t)((uint16_t)type >> 8 * i);
+			header[2 + i] = (uint8_t)((uint16_t)length >> 8 * i);
+			header[4 + i] = (uint8_t)(sequence_id >> 8 * i);
+			header[6 + i] = (uint8_t)(channel_sequence >> 8 * i);
 		}
-
-		m_SequenceId = ReadUint32();
-		m_Type = (PacketType)ReadUint16();
 	}
 
-	// Get data size
+	// Get data size, header included
 	size_t GetSize()
 	{
 		return m_Size;
 	}
 
-	uint32_t GetSequenceId()
+	bool IsReliable()
 	{
-		return m_SequenceId;
+		return GetChannel(m_Type).IsReliable();
 	}
 
 	// Get packet type identifier
@@ -89,11 +181,10 @@ public:
 		return m_Type;
 	}
 
-	// Get array of byte data
-	//std::array<uint8_t, NET_MSG_BUFFER_SIZE> GetData()
-	std::vector<uint8_t> GetData()
+	// Get the payload without header, the buffer is shared with the caller and must no longer be written to in place
+	SharedPayload GetPayload()
 	{
-		return m_Data;
+		return m_Payload;
 	}
 
 	void SetEndpoint(const asio::ip::udp::endpoint& endpoint)
@@ -106,244 +197,99 @@ public:
 		return m_Endpoint;
 	}
 
-	uint64_t GetDispatchTimestamp()
-	{
-		return m_DispatchTimestamp;
-	}
-
-	void SetDispatchTimestamp(uint64_t timestamp)
+	void Write(const std::vector<uint8_t>& values)
 	{
-		m_DispatchTimestamp = timestamp;
+		WriteRaw(values.data(), values.size());
 	}
 
-	bool Timeout()
+	// Write a contiguous array of primitives in one copy, e.g. tile data or entity lists
+	template<typename T>
+	void Write(std::span<const T> values)
 	{
-		return ++m_SendTimeout >= MAX_MSG_TIMEOUTS;
-	}
-
-	void Write(const std::vector<uint8_t>& values)
-	{
-		for (uint8_t byte : values)
-		{
-			Write(byte);
-		}
+		WriteRaw(values.data(), values.size());
 	}
 
 	void Write(uint8_t value)
 	{
-		//m_PacketData[m_Index++] = value;
-		//m_Size++;
-		m_Data.push_back(value);
-		m_Size = m_Data.size();
+		WriteRaw(&value, 1);
 	}
 
 	void Write(int8_t value)
 	{
-		Write((uint8_t)value);
+		WriteRaw(&value, 1);
 	}
 
-
 	void Write(int16_t value)
 	{
-		for (size_t i = 0; i < sizeof(int16_t); ++i)
-		{
-			Write((uint8_t)(value >> 8 * i));
-		}
+		WriteRaw(&value, 1);
 	}
 
 	void Write(uint16_t value)
 	{
-		for (size_t i = 0; i < sizeof(uint16_t); ++i)
-		{
-			Write((uint8_t)(value >> 8 * i));
-		}
+		WriteRaw(&value, 1);
 	}
 
 	void Write(int32_t value)
 	{
-		for (size_t i = 0; i < sizeof(int32_t); ++i)
-		{
-			Write((uint8_t)(value >> 8 * i));
-		}
+		WriteRaw(&value, 1);
 	}
 
 	void Write(uint32_t value)
 	{
-		for (size_t i = 0; i < sizeof(uint32_t); ++i)
-		{
-			Write((uint8_t)(value >> 8 * i));
-		}
+		WriteRaw(&value, 1);
 	}
 
 	void Write(int64_t value)
 	{
-		for (size_t i = 0; i < sizeof(int64_t); ++i)
-		{
-			Write((uint8_t)(value >> 8 * i));
-		}
+		WriteRaw(&value, 1);
 	}
 
 	void Write(uint64_t value)
 	{
-		for (size_t i = 0; i < sizeof(uint64_t); ++i)
-		{
-			Write((uint8_t)(value >> 8 * i));
-		}
+		WriteRaw(&value, 1);
 	}
 
 	void Write(float value)
 	{
-		uint8_t result[sizeof(float)];
-		memcpy(result, &value, sizeof(float));
-
-		for (size_t i = 0; i < sizeof(float); ++i)
-		{
-			Write(result[i]);
-		}
+		WriteRaw(&value, 1);
 	}
 
 	void Write(const Vector3& value)
 	{
-		Write((float)value.x);
-		Write((float)value.y);
-		Write((float)value.z);
+		float values[] = { value.x, value.y, value.z };
+		WriteRaw(values, 3);
 	}
 
 	void Write(const Vector2& value)
 	{
-		Write((float)value.x);
-		Write((float)value.y);
-	}
-
-	uint8_t ReadUint8()
-	{
-		return m_Data[m_Index++];
+		float values[] = { value.x, value.y };
+		WriteRaw(values, 2);
 	}
 
-	int8_t ReadInt8()
-	{
-		return (int8_t)ReadUint8();
-	}
-
-	uint16_t ReadUint16()
-	{
-		uint16_t value = 0;
-		for (size_t i = 0; i < sizeof(uint16_t); ++i)
-		{
-			value += (uint16_t)ReadUint8() << (8 * i);
-		}
-
-		return value;
-	}
-
-	int16_t ReadInt16()
-	{
-		int16_t value = 0;
-		for (size_t i = 0; i < sizeof(int16_t); ++i)
-		{
-			value += (int16_t)ReadUint8() << (8 * i);
-		}
-
-		return value;
-	}
-
-	uint32_t ReadUint32()
-	{
-		uint32_t value = 0;
-		for (size_t i = 0; i < sizeof(uint32_t); ++i)
-		{
-			value += (uint32_t)ReadUint8() << (8 * i);
-		}
-
-		return value;
-	}
-
-	int32_t ReadInt32()
-	{
-		int32_t value = 0;
-		for (size_t i = 0; i < sizeof(int32_t); ++i)
-		{
-			value += (int32_t)ReadUint8() << (8 * i);
-		}
-
-		return value;
-	}
-
-	uint64_t ReadUint64()
-	{
-		uint64_t value = 0;
-		for (size_t i = 0; i < sizeof(uint64_t); ++i)
-		{
-			value += (uint64_t)ReadUint8() << (8 * i);
-		}
-
-		return value;
-	}
-
-	int64_t ReadInt64()
-	{
-		int64_t value = 0;
-		for (size_t i = 0; i < sizeof(int64_t); ++i)
-		{
-			value += (int64_t)ReadUint8() << (8 * i);
-		}
-
-		return value;
-	}
-
-	float ReadFloat()
-	{
-		uint8_t buffer[sizeof(float)];
-		for (size_t i = 0; i < sizeof(float); ++i)
-		{
-			buffer[i] = ReadUint8();
-		}
-		return (*(float*)buffer);
-	}
-
-	const Vector3& ReadVector3()
+private:
+	// Append count values as they are laid out in memory, the wire format is little-endian like every supported target
+	template<typename T>
+	void WriteRaw(const T* values, size_t count)
 	{
-		//TODO: Clean up this function!!!
-		Vector3 ret;
-		uint8_t buffer[sizeof(float)];
-		for (size_t i = 0; i < sizeof(float); ++i)
-		{
-			buffer[i] = ReadUint8();
-		}
-		ret.x = (*(float*)buffer);
-
-		for (size_t i = 0; i < sizeof(float); ++i)
-		{
-			buffer[i] = ReadUint8();
-		}
-		ret.y = (*(float*)buffer);
-
-		for (size_t i = 0; i < sizeof(float); ++i)
-		{
-			buffer[i] = ReadUint8();
-		}
-		ret.z = (*(float*)buffer);
+		static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be written as raw bytes.");
 
-		return ret;
+		std::vector<uint8_t>& data = GetWritableData();
+		size_t offset = data.size();
+		data.resize(offset + sizeof(T) * count);
+		memcpy(data.data() + offset, values, sizeof(T) * count);
+		m_Size = NET_MSG_HEADER_SIZE + data.size();
 	}
 
-	const Vector2& ReadVector2()
+	// Writing after the payload was handed out copies it into a fresh buffer first
+	std::vector<uint8_t>& GetWritableData()
 	{
-		//TODO: Clean up this function!!!
-		Vector2 ret;
-		uint8_t buffer[sizeof(float)];
-		for (size_t i = 0; i < sizeof(float); ++i)
-		{
-			buffer[i] = ReadUint8();
-		}
-		ret.x = (*(float*)buffer);
-
-		for (size_t i = 0; i < sizeof(float); ++i)
+		if (m_Payload.UseCount() > 1)
 		{
-			buffer[i] = ReadUint8();
+			SharedPayload payload = BufferPool::Get().Acquire(GetBufferClass(m_Type));
+			payload.GetMutable() = *m_Payload;
+			m_Payload = std::move(payload);
 		}
-		ret.y = (*(float*)buffer);
 
-		return ret;
+		return m_Payload.GetMutable();
 	}
 };
\ No newline at end of file
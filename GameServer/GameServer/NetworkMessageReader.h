@@ -0,0 +1,189 @@
+#pragma once
+#include <chrono>
+#include "NetworkMessage.h"
+
+// Non-owning view of a received message inside the receive buffer, only valid while the datagram is being handled.
+// Reads past the end of the message return zero and mark the reader as overrun instead of touching other memory
+class NetworkMessageReader
+{
+private:
+	asio::ip::udp::endpoint m_Endpoint;
+	const uint8_t* m_Data = nullptr;
+	PacketType m_Type;
+	uint16_t m_SequenceId = 0;
+	uint16_t m_ChannelSequence = 0;
+	size_t m_Size = 0;
+	size_t m_Index = 0;
+	bool m_Overrun = false;
+	std::chrono::steady_clock::time_point m_ReceiveTime;
+
+public:
+
+	// View a received message of size bytes, header included
+	NetworkMessageReader(const uint8_t* data, size_t size, const asio::ip::udp::endpoint& sender_endpoint) : m_Endpoint(sender_endpoint), m_Data(data), m_Size(size)
+	{
+		m_Type = (PacketType)ReadUint16();
+		ReadUint16();
+		m_SequenceId = ReadUint16();
+		m_ChannelSequence = ReadUint16();
+	}
+
+	// Get data size
+	size_t GetSize()
+	{
+		return m_Size;
+	}
+
+	// Message bytes, header included
+	const uint8_t* GetData()
+	{
+		return m_Data;
+	}
+
+	// Message bytes after the header
+	std::span<const uint8_t> GetPayload()
+	{
+		return m_Size >= NET_MSG_HEADER_SIZE ? std::span<const uint8_t>(m_Data + NET_MSG_HEADER_SIZE, m_Size - NET_MSG_HEADER_SIZE) : std::span<const uint8_t>();
+	}
+
+	// Bytes left to read
+	size_t GetRemaining()
+	{
+		return m_Size - m_Index;
+	}
+
+	uint16_t GetSequenceId()
+	{
+		return m_SequenceId;
+	}
+
+	// Position within the stream of the message's channel, 0 if it is not sequenced
+	uint16_t GetChannelSequence()
+	{
+		return m_ChannelSequence;
+	}
+
+	// Get packet type identifier
+	PacketType GetType()
+	{
+		return m_Type;
+	}
+
+	const asio::ip::udp::endpoint& GetEndpoint()
+	{
+		return m_Endpoint;
+	}
+
+	// When the datagram carrying the message arrived, handlers run later on the simulation thread
+	std::chrono::steady_clock::time_point GetReceiveTime()
+	{
+		return m_ReceiveTime;
+	}
+
+	void SetReceiveTime(std::chrono::steady_clock::time_point time)
+	{
+		m_ReceiveTime = time;
+	}
+
+	// True once a read went past the end of the message
+	bool IsOverrun()
+	{
+		return m_Overrun;
+	}
+
+	uint8_t ReadUint8()
+	{
+		return Read<uint8_t>();
+	}
+
+	int8_t ReadInt8()
+	{
+		return Read<int8_t>();
+	}
+
+	uint16_t ReadUint16()
+	{
+		return Read<uint16_t>();
+	}
+
+	int16_t ReadInt16()
+	{
+		return Read<int16_t>();
+	}
+
+	uint32_t ReadUint32()
+	{
+		return Read<uint32_t>();
+	}
+
+	int32_t ReadInt32()
+	{
+		return Read<int32_t>();
+	}
+
+	uint64_t ReadUint64()
+	{
+		return Read<uint64_t>();
+	}
+
+	int64_t ReadInt64()
+	{
+		return Read<int64_t>();
+	}
+
+	float ReadFloat()
+	{
+		return Read<float>();
+	}
+
+	Vector3 ReadVector3()
+	{
+		float values[3]{};
+		ReadArray(std::span<float>(values));
+		return Vector3{ values[0], values[1], values[2] };
+	}
+
+	Vector2 ReadVector2()
+	{
+		float values[2]{};
+		ReadArray(std::span<float>(values));
+		return Vector2{ values[0], values[1] };
+	}
+
+	// Fill values with a contiguous array written by NetworkMessage::Write(std::span), returns false if the message is too short
+	template<typename T>
+	bool ReadArray(std::span<T> values)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be read as raw bytes.");
+
+		if (!CanRead(values.size_bytes()))
+		{
+			return false;
+		}
+
+		memcpy(values.data(), m_Data + m_Index, values.size_bytes());
+		m_Index += values.size_bytes();
+		return true;
+	}
+
+private:
+	template<typename T>
+	T Read()
+	{
+		T value{};
+		ReadArray(std::span<T>(&value, 1));
+		return value;
+	}
+
+	bool CanRead(size_t size)
+	{
+		if (size > m_Size - m_Index)
+		{
+			m_Overrun = true;
+			m_Index = m_Size;
+			return false;
+		}
+
+		return true;
+	}
+};
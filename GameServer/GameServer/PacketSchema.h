@@ -0,0 +1,160 @@
+#pragma once
+#include <array>
+#include <span>
+#include <cstring>
+#include <type_traits>
+#include "NetworkMessage.h"
+
+// Declarative payload layouts. A packet is a struct naming its PacketType and listing the members that go on the wire:
+//
+//	struct ClientMovement
+//	{
+//		static constexpr PacketType TYPE = PacketType::Movement;
+//		Vector2 m_Direction;
+//		using Fields = FieldList<&ClientMovement::m_Direction>;
+//	};
+//
+// Fields are written back to back in list order without padding, little-endian like everything NetworkMessage writes.
+// Only fixed size, trivially copyable fields are supported so every packet has one size known at compile time
+
+template<typename>
+struct MemberTraits;
+
+template<typename Class, typename Type>
+struct MemberTraits<Type Class::*>
+{
+	using ClassType = Class;
+	using FieldType = Type;
+};
+
+template<auto... Members>
+struct FieldList
+{
+	static_assert((std::is_trivially_copyable_v<typename MemberTraits<decltype(Members)>::FieldType> && ...), "Packet fields have to be trivially copyable.");
+
+	static constexpr size_t SIZE = (sizeof(typename MemberTraits<decltype(Members)>::FieldType) + ... + 0);
+
+	template<typename Packet>
+	static constexpr bool IsOf = (std::is_same_v<typename MemberTraits<decltype(Members)>::ClassType, Packet> && ...);
+
+	// Offsets are constants once inlined, so these compile down to plain loads and stores
+	template<typename Packet>
+	static void Read(const uint8_t* data, Packet& packet)
+	{
+		size_t offset = 0;
+		((memcpy(&(packet.*Members), data + offset, sizeof(packet.*Members)), offset += sizeof(packet.*Members)), ...);
+	}
+
+	template<typename Packet>
+	static void Write(const Packet& packet, uint8_t* data)
+	{
+		size_t offset = 0;
+		((memcpy(data + offset, &(packet.*Members), sizeof(packet.*Members)), offset += sizeof(packet.*Members)), ...);
+	}
+};
+
+template<typename Packet>
+class PacketCodec
+{
+	using Fields = typename Packet::Fields;
+	static_assert(Fields::template IsOf<Packet>, "Packet fields have to be members of the packet itself.");
+
+public:
+	static constexpr size_t SIZE = Fields::SIZE;
+
+	// The one bounds check, a payload of any other size is rejected before a field is read
+	static bool Decode(std::span<const uint8_t> payload, Packet& packet)
+	{
+		if (payload.size() != SIZE)
+		{
+			return false;
+		}
+
+		Fields::Read(payload.data(), packet);
+		return true;
+	}
+
+	static std::array<uint8_t, SIZE> Encode(const Packet& packet)
+	{
+		std::array<uint8_t, SIZE> data;
+		Fields::Write(packet, data.data());
+		return data;
+	}
+};
+
+// Message carrying the encoded packet, ready to be sent
+template<typename Packet>
+NetworkMessage MakeMessage(const Packet& packet, const asio::ip::udp::endpoint& receiver_endpoint)
+{
+	NetworkMessage msg(Packet::TYPE, receiver_endpoint);
+	if constexpr (PacketCodec<Packet>::SIZE > 0)
+	{
+		std::array<uint8_t, PacketCodec<Packet>::SIZE> data = PacketCodec<Packet>::Encode(packet);
+		msg.Write(std::span<const uint8_t>(data));
+	}
+	return msg;
+}
+
+// Binds a packet to the member function of the dispatcher's owner handling it
+template<typename BoundPacket, auto Handler>
+struct Rpc
+{
+	using Packet = BoundPacket;
+	using HandlerType = decltype(Handler);
+	static constexpr HandlerType HANDLER = Handler;
+};
+
+enum class RpcResult
+{
+	Handled,
+	Malformed,	// The payload does not have the size of the packet bound to its type
+	Unknown		// No packet is bound to the type
+};
+
+// Dispatch fixed at compile time: every handler has to be a void(Connection&, const Packet&) member of Owner and
+// each packet type can only be bound once. The decode and the call are inlined into one branch per bound type
+template<typename Owner, typename... Rpcs>
+class RpcDispatcher
+{
+	static_assert((std::is_same_v<typename Rpcs::HandlerType, void (Owner::*)(Connection&, const typename Rpcs::Packet&)> && ...),
+		"Handlers have to be void(Connection&, const Packet&) members taking the packet they are bound to.");
+
+	static constexpr bool HasUniqueTypes()
+	{
+		std::array<PacketType, sizeof...(Rpcs)> types{ Rpcs::Packet::TYPE... };
+		for (size_t i = 0; i < types.size(); ++i)
+		{
+			for (size_t j = i + 1; j < types.size(); ++j)
+			{
+				if (types[i] == types[j])
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+	static_assert(HasUniqueTypes(), "A packet type is bound to more than one handler.");
+
+public:
+	static RpcResult Invoke(Owner& owner, PacketType type, Connection& client, std::span<const uint8_t> payload)
+	{
+		RpcResult result = RpcResult::Unknown;
+		((type == Rpcs::Packet::TYPE && (result = Call<Rpcs>(owner, client, payload), true)) || ...);
+		return result;
+	}
+
+private:
+	template<typename Bound>
+	static RpcResult Call(Owner& owner, Connection& client, std::span<const uint8_t> payload)
+	{
+		typename Bound::Packet packet;
+		if (!PacketCodec<typename Bound::Packet>::Decode(payload, packet))
+		{
+			return RpcResult::Malformed;
+		}
+
+		(owner.*Bound::HANDLER)(client, packet);
+		return RpcResult::Handled;
+	}
+};
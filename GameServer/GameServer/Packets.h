@@ -0,0 +1,86 @@
+#pragma once
+#include "PacketSchema.h"
+#include "ConnectCookie.h"
+
+// Payloads of the fixed size messages, see PacketSchema.h. The client writes and reads the same fields in the same order.
+// Bit packed state (Movement broadcasts, Snapshot) is written with BitWriter instead
+
+// Client to server
+
+struct ClientDisconnect
+{
+	static constexpr PacketType TYPE = PacketType::Disconnect;
+	uint32_t m_Id;	// Id we gave the client, not trusted
+	using Fields = FieldList<&ClientDisconnect::m_Id>;
+};
+
+// Answer to ServerHandShake, the first HandShakes of an endpoint carry a cookie instead and are handled by Network
+struct ClientHandShake
+{
+	static constexpr PacketType TYPE = PacketType::HandShake;
+	uint64_t m_Timestamp;	// Echo of ServerHandShake::m_Timestamp
+	using Fields = FieldList<&ClientHandShake::m_Timestamp>;
+};
+
+// Sent when the client has nothing else to carry its acks
+struct ClientAcknowledge
+{
+	static constexpr PacketType TYPE = PacketType::Acknowledge;
+	using Fields = FieldList<>;
+};
+
+struct ClientPing
+{
+	static constexpr PacketType TYPE = PacketType::Ping;
+	uint64_t m_Timestamp;	// Echo of ServerPing::m_Timestamp
+	using Fields = FieldList<&ClientPing::m_Timestamp>;
+};
+
+struct ClientMovement
+{
+	static constexpr PacketType TYPE = PacketType::Movement;
+	Vector2 m_Direction;
+	using Fields = FieldList<&ClientMovement::m_Direction>;
+};
+
+// Server to client
+
+struct ServerHandShake
+{
+	static constexpr PacketType TYPE = PacketType::HandShake;
+	uint32_t m_Id;
+	uint64_t m_Timestamp;	// RoundtripEstimator timestamp for the client to echo
+	using Fields = FieldList<&ServerHandShake::m_Id, &ServerHandShake::m_Timestamp>;
+};
+
+struct ServerChallenge
+{
+	static constexpr PacketType TYPE = PacketType::Challenge;
+	std::array<uint8_t, COOKIE_SIZE> m_Cookie;	// See ConnectCookie
+	using Fields = FieldList<&ServerChallenge::m_Cookie>;
+};
+
+struct ServerPing
+{
+	static constexpr PacketType TYPE = PacketType::Ping;
+	uint64_t m_Roundtrip;	// Smoothed roundtrip in milliseconds for display
+	uint64_t m_Timestamp;	// RoundtripEstimator timestamp for the client to echo
+	using Fields = FieldList<&ServerPing::m_Roundtrip, &ServerPing::m_Timestamp>;
+};
+
+// A player entered the client's view
+struct ServerPlayerData
+{
+	static constexpr PacketType TYPE = PacketType::PlayerData;
+	uint32_t m_Id;
+	Vector3 m_Position;
+	using Fields = FieldList<&ServerPlayerData::m_Id, &ServerPlayerData::m_Position>;
+};
+
+// A player left the client's view
+struct ServerRemoveCreature
+{
+	static constexpr PacketType TYPE = PacketType::RemoveCreature;
+	uint32_t m_Id;
+	using Fields = FieldList<&ServerRemoveCreature::m_Id>;
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include <mutex>
+#include <chrono>
+#include <iostream>
+
+// Caps the lines printed per second for log output a remote can trigger at will, printing to the console
+// is slow enough to be a cost of its own. Lines over the cap are counted and reported before the next one printed
+class RateLimitedLog
+{
+public:
+	RateLimitedLog(uint32_t lines_per_second) : m_Limit(lines_per_second) {}
+
+	// Returns true if a line may be printed now
+	bool Allow()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now - m_WindowStart >= std::chrono::seconds(1))
+		{
+			m_WindowStart = now;
+			m_Printed = 0;
+		}
+
+		if (m_Printed >= m_Limit)
+		{
+			m_Suppressed++;
+			return false;
+		}
+
+		m_Printed++;
+		if (m_Suppressed > 0)
+		{
+			std::cout << "[Log] " << m_Suppressed << " similar lines suppressed" << std::endl;
+			m_Suppressed = 0;
+		}
+		return true;
+	}
+
+private:
+	std::mutex m_Mutex;
+	uint32_t m_Limit;
+	uint32_t m_Printed = 0;
+	uint64_t m_Suppressed = 0;
+	std::chrono::steady_clock::time_point m_WindowStart;
+};
@@ -0,0 +1,417 @@
+#pragma once
+#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "NetworkMessage.h"
+#include "RetransmitScheduler.h"
+#include "CongestionControl.h"
+#include "RoundtripEstimator.h"
+
+const uint32_t RELIABLE_WINDOW_SIZE = 1024;	// Max amount of unacknowledged reliable messages per connection, must be a power of two
+const uint8_t MAX_MSG_TIMEOUTS = 32;		// Max amount of nack's before msg is timedout
+const uint8_t ACK_BITS = 32;				// Amount of sequence ids acknowledged by the ack bitfield besides the latest
+const uint32_t RECEIVED_WINDOW_SIZE = 1024;	// Sequence ids behind the latest received one that are remembered, older ones are stale. Power of two below 32768
+const std::chrono::milliseconds LOSS_REORDER_TIME(10);	// Unacknowledged messages sent this long before an acknowledged one count as lost, grows when reordering is taken for loss
+
+// Per connection reliability state, sent reliable messages are stored in a ring buffer indexed by sequence id
+// until the remote acknowledges them through the "latest ack + ack bitfield" packet header.
+// Sequence ids are 16 bit and wrap around skipping 0, each direction of a connection numbers its messages on its own.
+// Received ids are remembered in a bitmap sliding along with the latest one so duplicates can be told apart.
+// Everything sent to the connection is paid for from the send budget of its CongestionController,
+// resends wait for the retransmit timeout of its RoundtripEstimator
+class ReliableWindow
+{
+public:
+	ReliableWindow(const asio::ip::udp::endpoint& endpoint, uint32_t send_rate, uint32_t max_send_rate)
+		: m_Endpoint(endpoint), m_Slots(RELIABLE_WINDOW_SIZE), m_Congestion(send_rate, max_send_rate)
+	{
+		m_SendRate = m_Congestion.GetRate();
+		m_RetransmitTimeout = m_Roundtrip.GetTimeout(0).count();
+	}
+
+	const asio::ip::udp::endpoint& GetEndpoint() { return m_Endpoint; }
+	RetransmitScheduler::Clock::duration GetRoundtripTime() { return RetransmitScheduler::Clock::duration(m_RoundtripTime); }
+	RetransmitScheduler::Clock::duration GetRoundtripVariation() { return RetransmitScheduler::Clock::duration(m_RoundtripVariation); }
+	RetransmitScheduler::Clock::duration GetRetransmitTimeout() { return RetransmitScheduler::Clock::duration(m_RetransmitTimeout); }
+	uint32_t GetPendingCount() { return m_PendingCount; }
+	uint64_t GetOverflows() { return m_Overflows; }
+	// A reliable message was dropped before it was acknowledged, its ordered stream can never catch up again
+	bool HasLostReliable() { return m_ReliableLost; }
+	uint32_t GetAckedTag() { return m_AckedTag; }
+	uint32_t GetLastTrackedTag() { return m_LastTrackedTag; }
+	uint32_t GetSendRate() { return m_SendRate; }
+	uint64_t GetHeldBackRetransmits() { return m_HeldBackRetransmits; }
+	uint64_t GetAcked() { return m_Acked; }
+	uint64_t GetLost() { return m_Lost; }
+	uint64_t GetGivenUp() { return m_GivenUp; }
+
+	// Roundtrip measured outside of acks, e.g. by an echoed Ping
+	void AddRoundtripSample(RetransmitScheduler::Clock::duration sample)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		AddSample(sample);
+	}
+
+	// Assign the next sequence id to a reliable message and hold on to its payload until acknowledged, returns the sequence id
+	uint16_t Push(PacketType type, uint16_t channel_sequence, const SharedPayload& payload, RetransmitScheduler::Clock::time_point timestamp)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		m_Sequence = NextSequenceId(m_Sequence);
+		Slot& slot = m_Slots[m_Sequence & (RELIABLE_WINDOW_SIZE - 1)];
+		if (slot.m_Pending && slot.m_Reliable)
+		{
+			// The window is full, the oldest message has been outstanding for a whole window and is given up on
+			m_Overflows++;
+			m_ReliableLost = true;
+		}
+		else
+		{
+			m_PendingCount++;
+		}
+
+		slot.m_Sequence = m_Sequence;
+		slot.m_Pending = true;
+		slot.m_Reliable = true;
+		slot.m_Type = type;
+		slot.m_ChannelSequence = channel_sequence;
+		slot.m_Payload = payload;
+		slot.m_DispatchTimestamp = timestamp;
+		slot.m_SendTimeout = 0;
+		slot.m_Sent = true;
+		slot.m_Lost = false;
+
+		return m_Sequence;
+	}
+
+	// Assign sequence ids to an unreliable message that is never resent but whose delivery is tracked,
+	// the highest tag acknowledged so far is available through GetAckedTag. A message split into fragments
+	// gets consecutive sequence ids and only counts as acknowledged once every fragment is.
+	// Returns the sequence id of the first fragment
+	uint16_t PushTracked(uint32_t tag, uint32_t fragments = 1)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		RetransmitScheduler::Clock::time_point timestamp = RetransmitScheduler::Clock::now();
+
+		uint16_t first = 0;
+		for (uint32_t i = 0; i < fragments; ++i)
+		{
+			m_Sequence = NextSequenceId(m_Sequence);
+			Slot& slot = m_Slots[m_Sequence & (RELIABLE_WINDOW_SIZE - 1)];
+			if (slot.m_Pending && slot.m_Reliable)
+			{
+				m_Overflows++;
+				m_ReliableLost = true;
+				m_PendingCount--;
+			}
+
+			if (i == 0)
+			{
+				first = m_Sequence;
+			}
+
+			slot.m_Sequence = m_Sequence;
+			slot.m_Pending = true;
+			slot.m_Reliable = false;
+			slot.m_Tag = tag;
+			slot.m_First = first;
+			slot.m_Unacked = fragments;
+			slot.m_Payload.reset();
+			slot.m_DispatchTimestamp = timestamp;
+			slot.m_SendTimeout = 0;
+			slot.m_Sent = false;
+			slot.m_Lost = false;
+		}
+		m_LastTrackedTag = tag;
+
+		return first;
+	}
+
+	// Write the packet header acknowledging what we received from the remote so far
+	void WritePacketHeader(uint8_t* header)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		WriteAcks(header);
+	}
+
+	// Pay for a datagram about to be sent, returns false if it exceeds the send budget
+	bool ConsumeBudget(size_t size, RetransmitScheduler::Clock::time_point timestamp)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		bool allowed = m_Congestion.TryConsume(size, timestamp);
+		m_SendRate = m_Congestion.GetRate();
+		return allowed;
+	}
+
+	// Release every message covered by the received ack header, messages missing from it while ones sent
+	// after them arrived are reported to congestion control as lost
+	void Acknowledge(uint16_t ack, uint32_t ack_bits)
+	{
+		if (ack == 0)
+		{
+			return;
+		}
+
+		// Bit i stands for ack - 1 - i in wrapping arithmetic, the bit of the skipped id 0 is never set
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		RetransmitScheduler::Clock::time_point now = RetransmitScheduler::Clock::now();
+		Release(ack, now);
+		for (uint32_t i = 0; i < ACK_BITS; ++i)
+		{
+			uint16_t sequence_id = (uint16_t)(ack - 1 - i);
+			if (ack_bits & (1u << i))
+			{
+				Release(sequence_id, now);
+			}
+			else
+			{
+				Lose(sequence_id);
+			}
+		}
+	}
+
+	// Track a sequence id received from the remote so it is acknowledged in our next header.
+	// Returns false if it was received before or is too old to tell, the message must not be handled again
+	bool Received(uint16_t sequence_id)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		if (m_RemoteSequence == 0 || IsSequenceNewer(sequence_id, m_RemoteSequence))
+		{
+			// Slide the window forward, forgetting whatever was received a whole window ago at the ids now coming up
+			uint16_t distance = m_RemoteSequence == 0 ? RECEIVED_WINDOW_SIZE : (uint16_t)(sequence_id - m_RemoteSequence);
+			if (distance >= RECEIVED_WINDOW_SIZE)
+			{
+				std::fill(std::begin(m_ReceivedBits), std::end(m_ReceivedBits), 0);
+			}
+			else
+			{
+				for (uint16_t id = m_RemoteSequence + 1; id != sequence_id; ++id)
+				{
+					SetReceived(id, false);
+				}
+			}
+
+			SetReceived(sequence_id, true);
+			m_RemoteSequence = sequence_id;
+			return true;
+		}
+
+		if ((uint16_t)(m_RemoteSequence - sequence_id) >= RECEIVED_WINDOW_SIZE || IsReceived(sequence_id))
+		{
+			return false;
+		}
+
+		SetReceived(sequence_id, true);
+		return true;
+	}
+
+	// Tracked messages left the bundle, until then they can not get lost
+	void MarkSent(const std::vector<uint16_t>& sequence_ids, RetransmitScheduler::Clock::time_point timestamp)
+	{
+		if (sequence_ids.empty())
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (uint16_t sequence_id : sequence_ids)
+		{
+			Slot& slot = m_Slots[sequence_id & (RELIABLE_WINDOW_SIZE - 1)];
+			if (slot.m_Pending && slot.m_Sequence == sequence_id)
+			{
+				slot.m_Sent = true;
+				slot.m_DispatchTimestamp = timestamp;
+			}
+		}
+	}
+
+	// Resend a message whose retransmit deadline passed, transmit(buffers) is called with a datagram holding only
+	// that message if it is still unacknowledged. While the send budget is used up the message is held back
+	// without counting as a timeout.
+	// Returns true with the next deadline if the message needs to be scheduled again
+	template<typename Func>
+	bool Retransmit(uint16_t sequence_id, RetransmitScheduler::Clock::time_point timestamp, Func transmit, RetransmitScheduler::Clock::time_point& next_deadline)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		Slot& slot = m_Slots[sequence_id & (RELIABLE_WINDOW_SIZE - 1)];
+		if (!slot.m_Pending || !slot.m_Reliable || slot.m_Sequence != sequence_id)
+		{
+			return false;
+		}
+
+		bool allowed = m_Congestion.TryConsume(sizeof(m_RetransmitHeader) + slot.m_Payload->size(), timestamp);
+		m_SendRate = m_Congestion.GetRate();
+		if (!allowed)
+		{
+			m_HeldBackRetransmits++;
+			next_deadline = m_Congestion.Reserve(sizeof(m_RetransmitHeader) + slot.m_Payload->size(), timestamp);
+			return true;
+		}
+
+		// Fresh headers in front of the payload shared with the original send
+		WriteAcks(m_RetransmitHeader);
+		NetworkMessage::WriteHeader(m_RetransmitHeader + NET_PACKET_HEADER_SIZE, slot.m_Type, slot.m_Payload->size(), sequence_id, slot.m_ChannelSequence);
+		m_RetransmitBuffers.clear();
+		m_RetransmitBuffers.push_back(asio::buffer(m_RetransmitHeader));
+		m_RetransmitBuffers.push_back(asio::buffer(*slot.m_Payload));
+
+		slot.m_DispatchTimestamp = timestamp;
+		slot.m_Lost = false;
+		transmit(m_RetransmitBuffers);
+
+		if (++slot.m_SendTimeout >= MAX_MSG_TIMEOUTS)
+		{
+			slot.m_Pending = false;
+			slot.m_Payload.reset();
+			m_PendingCount--;
+			m_GivenUp++;
+			m_ReliableLost = true;
+			return false;
+		}
+
+		next_deadline = timestamp + m_Roundtrip.GetTimeout(slot.m_SendTimeout);
+		return true;
+	}
+
+private:
+	void WriteAcks(uint8_t* header)
+	{
+		uint32_t ack_bits = 0;
+		for (uint32_t i = 0; i < ACK_BITS; ++i)
+		{
+			if (m_RemoteSequence != 0 && IsReceived((uint16_t)(m_RemoteSequence - 1 - i)))
+			{
+				ack_bits |= 1u << i;
+			}
+		}
+
+		header[0] = (uint8_t)m_RemoteSequence;
+		header[1] = (uint8_t)(m_RemoteSequence >> 8);
+		for (size_t i = 0; i < sizeof(uint32_t); ++i)
+		{
+			header[2 + i] = (uint8_t)(ack_bits >> 8 * i);
+		}
+	}
+
+	bool IsReceived(uint16_t sequence_id)
+	{
+		uint32_t index = sequence_id & (RECEIVED_WINDOW_SIZE - 1);
+		return (m_ReceivedBits[index / 64] >> (index % 64)) & 1;
+	}
+
+	void SetReceived(uint16_t sequence_id, bool received)
+	{
+		uint32_t index = sequence_id & (RECEIVED_WINDOW_SIZE - 1);
+		uint64_t bit = 1ull << (index % 64);
+		m_ReceivedBits[index / 64] = received ? m_ReceivedBits[index / 64] | bit : m_ReceivedBits[index / 64] & ~bit;
+	}
+
+	void Release(uint16_t sequence_id, RetransmitScheduler::Clock::time_point now)
+	{
+		Slot& slot = m_Slots[sequence_id & (RELIABLE_WINDOW_SIZE - 1)];
+		if (!slot.m_Pending || slot.m_Sequence != sequence_id)
+		{
+			return;
+		}
+
+		slot.m_Pending = false;
+		m_LatestAckedDispatch = std::max(m_LatestAckedDispatch, slot.m_DispatchTimestamp);
+		m_Congestion.OnAcked();
+		m_Acked++;
+		if (slot.m_Lost)
+		{
+			// It was only overtaken, wait longer for reordered messages up to a roundtrip
+			m_Congestion.OnSpuriousLoss();
+			m_Lost--;
+			m_ReorderTime = std::min(2 * m_ReorderTime, std::max<RetransmitScheduler::Clock::duration>(LOSS_REORDER_TIME, m_Roundtrip.GetSmoothed()));
+		}
+		if (slot.m_Sent && slot.m_SendTimeout == 0)
+		{
+			// A resent message could be acknowledged for any of its sends, only first sends measure the roundtrip
+			m_Congestion.OnRoundtrip(now - slot.m_DispatchTimestamp);
+			AddSample(now - slot.m_DispatchTimestamp);
+		}
+		if (slot.m_Reliable)
+		{
+			slot.m_Payload.reset();
+			m_PendingCount--;
+		}
+		else
+		{
+			// The first fragment keeps count of the fragments still unacknowledged
+			Slot& first = m_Slots[slot.m_First & (RELIABLE_WINDOW_SIZE - 1)];
+			if (first.m_Sequence == slot.m_First && --first.m_Unacked == 0 && slot.m_Tag > m_AckedTag)
+			{
+				m_AckedTag = slot.m_Tag;
+			}
+		}
+	}
+
+	// Judged by send time rather than sequence id since retransmits go out after messages with higher ids.
+	// Counted once per send, a resent message can get lost again
+	void Lose(uint16_t sequence_id)
+	{
+		Slot& slot = m_Slots[sequence_id & (RELIABLE_WINDOW_SIZE - 1)];
+		if (slot.m_Pending && slot.m_Sent && !slot.m_Lost && slot.m_Sequence == sequence_id
+			&& slot.m_DispatchTimestamp + m_ReorderTime < m_LatestAckedDispatch)
+		{
+			slot.m_Lost = true;
+			m_Congestion.OnLost();
+			m_Lost++;
+		}
+	}
+
+	void AddSample(RetransmitScheduler::Clock::duration sample)
+	{
+		m_Roundtrip.AddSample(sample);
+		m_RoundtripTime = m_Roundtrip.GetSmoothed().count();
+		m_RoundtripVariation = m_Roundtrip.GetVariation().count();
+		m_RetransmitTimeout = m_Roundtrip.GetTimeout(0).count();
+	}
+
+	struct Slot
+	{
+		uint16_t m_Sequence = 0;
+		bool m_Pending = false;
+		bool m_Reliable = false;
+		uint32_t m_Tag = 0;
+		uint16_t m_First = 0;	// Sequence id of the first fragment of a tracked message
+		uint32_t m_Unacked = 0;	// Fragments of a tracked message not acknowledged yet, only kept up to date on the first
+		PacketType m_Type = PacketType::Disconnect;
+		uint16_t m_ChannelSequence = 0;
+		SharedPayload m_Payload;
+		RetransmitScheduler::Clock::time_point m_DispatchTimestamp;
+		uint8_t m_SendTimeout = 0;
+		bool m_Sent = false;	// False while a tracked message waits in the bundle
+		bool m_Lost = false;	// Reported as lost since it was last sent
+	};
+
+	asio::ip::udp::endpoint m_Endpoint;
+	std::mutex m_Mutex;
+	std::vector<Slot> m_Slots;
+	uint8_t m_RetransmitHeader[NET_PACKET_HEADER_SIZE + NET_MSG_HEADER_SIZE]{};
+	DatagramBuffers m_RetransmitBuffers;
+	uint16_t m_Sequence = 0;
+	std::atomic<uint32_t> m_PendingCount{};
+	uint16_t m_RemoteSequence = 0;
+	uint64_t m_ReceivedBits[RECEIVED_WINDOW_SIZE / 64]{};	// Received ids behind and including m_RemoteSequence, indexed by id
+	RoundtripEstimator m_Roundtrip;
+	std::atomic<RetransmitScheduler::Clock::rep> m_RoundtripTime{};
+	std::atomic<RetransmitScheduler::Clock::rep> m_RoundtripVariation{};
+	std::atomic<RetransmitScheduler::Clock::rep> m_RetransmitTimeout{};
+	std::atomic<uint64_t> m_Overflows{};
+	std::atomic<uint32_t> m_AckedTag{};
+	std::atomic<uint32_t> m_LastTrackedTag{};
+	CongestionController m_Congestion;
+	RetransmitScheduler::Clock::time_point m_LatestAckedDispatch;
+	RetransmitScheduler::Clock::duration m_ReorderTime = LOSS_REORDER_TIME;
+	std::atomic<uint32_t> m_SendRate{};
+	std::atomic<uint64_t> m_HeldBackRetransmits{};
+	std::atomic<uint64_t> m_Acked{};
+	std::atomic<uint64_t> m_Lost{};
+	std::atomic<uint64_t> m_GivenUp{};
+	std::atomic<bool> m_ReliableLost{};
+};
@@ -0,0 +1,104 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <queue>
+#include <vector>
+#include <memory>
+
+class ReliableWindow;
+
+// Min-heap of reliable messages keyed on their next retransmit deadline. Acknowledged messages are not removed,
+// their entry is discarded by ReliableWindow::Retransmit once it comes due
+class RetransmitScheduler
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Entry
+	{
+		Clock::time_point m_Deadline;
+		std::shared_ptr<ReliableWindow> m_Window;
+		uint16_t m_Sequence;
+
+		bool operator>(const Entry& rhs) const { return m_Deadline > rhs.m_Deadline; }
+	};
+
+	void Schedule(const std::shared_ptr<ReliableWindow>& window, uint16_t sequence_id, Clock::time_point deadline)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		bool earliest = m_Entries.empty() || deadline < m_Entries.top().m_Deadline;
+		m_Entries.push(Entry{ deadline, window, sequence_id });
+
+		// Only wake the dispatcher when it is sleeping towards a later deadline
+		if (earliest)
+		{
+			m_Condition.notify_one();
+		}
+	}
+
+	// Put back entries returned by WaitForDue with their updated deadlines
+	void Reschedule(std::vector<Entry>& entries)
+	{
+		if (entries.empty())
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (Entry& entry : entries)
+		{
+			m_Entries.push(std::move(entry));
+		}
+		m_Condition.notify_one();
+	}
+
+	// Sleep until the earliest deadline has passed and move every due entry into due, returns false once stopped
+	bool WaitForDue(std::vector<Entry>& due)
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		while (!m_Stopped)
+		{
+			if (m_Entries.empty())
+			{
+				m_Condition.wait(lock);
+				continue;
+			}
+
+			Clock::time_point now = Clock::now();
+			if (m_Entries.top().m_Deadline > now)
+			{
+				m_Condition.wait_until(lock, m_Entries.top().m_Deadline);
+				continue;
+			}
+
+			while (!m_Entries.empty() && m_Entries.top().m_Deadline <= now)
+			{
+				due.push_back(m_Entries.top());
+				m_Entries.pop();
+			}
+			return true;
+		}
+
+		return false;
+	}
+
+	void Stop()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopped = true;
+		m_Condition.notify_all();
+	}
+
+	size_t Size()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Entries.size();
+	}
+
+private:
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> m_Entries;
+	bool m_Stopped = false;
+};
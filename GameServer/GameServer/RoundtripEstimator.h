@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include "RetransmitScheduler.h"
+
+const std::chrono::milliseconds RTO_INITIAL(250);	// Retransmit timeout before the first roundtrip sample
+const std::chrono::milliseconds RTO_MIN(50);		// Lower bound of the retransmit timeout, covers the remote's ack delay
+const std::chrono::milliseconds RTO_MAX(2000);		// Upper bound of the retransmit timeout, backoff included
+const std::chrono::milliseconds RTT_MAX_SAMPLE(10000);	// Samples above this are bogus echoes and ignored
+const uint8_t RTO_MAX_BACKOFF = 5;					// Max amount of times the timeout of a message is doubled
+
+inline double ToMilliseconds(RetransmitScheduler::Clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Smoothed roundtrip time and retransmit timeout after RFC 6298: SRTT and RTTVAR are moving averages of the samples
+// and their deviation, RTO = SRTT + 4 * RTTVAR. Every timeout of a message doubles its next one.
+// Not thread safe, owned by a connection's ReliableWindow and only used under its lock
+class RoundtripEstimator
+{
+public:
+	using Clock = RetransmitScheduler::Clock;
+
+	Clock::duration GetSmoothed() { return m_Smoothed; }
+	Clock::duration GetVariation() { return m_Variation; }
+	bool HasSamples() { return m_Samples > 0; }
+
+	void AddSample(Clock::duration sample)
+	{
+		if (sample < Clock::duration::zero() || sample > RTT_MAX_SAMPLE)
+		{
+			return;
+		}
+
+		if (m_Samples++ == 0)
+		{
+			m_Smoothed = sample;
+			m_Variation = sample / 2;
+		}
+		else
+		{
+			Clock::duration deviation = sample > m_Smoothed ? sample - m_Smoothed : m_Smoothed - sample;
+			m_Variation = (3 * m_Variation + deviation) / 4;
+			m_Smoothed = (7 * m_Smoothed + sample) / 8;
+		}
+
+		m_Timeout = std::clamp<Clock::duration>(m_Smoothed + 4 * m_Variation, RTO_MIN, RTO_MAX);
+	}
+
+	// Time to wait for an ack of a message that already timed out the given amount of times
+	Clock::duration GetTimeout(uint8_t timeouts)
+	{
+		return std::min<Clock::duration>(m_Timeout * (1 << std::min(timeouts, RTO_MAX_BACKOFF)), RTO_MAX);
+	}
+
+	// Timestamps echoed by the remote in HandShake and Ping, microseconds on the steady clock
+	static uint64_t ToTimestamp(Clock::time_point time)
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+	}
+
+	static Clock::duration SinceTimestamp(uint64_t timestamp, Clock::time_point now)
+	{
+		return now.time_since_epoch() - std::chrono::duration_cast<Clock::duration>(std::chrono::microseconds(timestamp));
+	}
+
+private:
+	Clock::duration m_Smoothed{};
+	Clock::duration m_Variation{};
+	Clock::duration m_Timeout = RTO_INITIAL;
+	uint64_t m_Samples = 0;
+};
@@ -2,39 +2,31 @@
 #include "Network.h"
 #include "Game.h"
 
-void RpcManager::Invoke(const PacketType& type, Connection& client, NetworkMessage& data)
+void RpcManager::Invoke(const PacketType& type, Connection& client, NetworkMessageReader& data)
 {
-	if (type < PacketType::MAX_SIZE && m_Rpc[(uint16_t)type] != nullptr)
+	m_ReceiveTime = data.GetReceiveTime();
+	RpcResult result = Handlers::Invoke(*this, type, client, data.GetPayload());
+
+	// The client repeats its cookie HandShake until our answer arrives, late copies are expected
+	if (result == RpcResult::Malformed && !(type == PacketType::HandShake && data.GetPayload().size() == COOKIE_SIZE) && m_Log.Allow())
 	{
-		std::invoke(m_Rpc[(uint16_t)type], this, client, data);
+		std::cout << "[RPC] Received malformed packet type '" << (uint16_t)type << "' (" << data.GetPayload().size() << " bytes) from " << client.m_Endpoint << std::endl;
 	}
-	else
+	else if (result == RpcResult::Unknown && m_Log.Allow())
 	{
 		std::cout << "[RPC] Received unknown packet type '" << (uint16_t)type << "' from " << client.m_Endpoint << std::endl;
 	}
 }
 
-void RpcManager::Init()
-{
-	m_Rpc[(uint16_t)PacketType::Disconnect]		= &RpcManager::Disconnect;
-	m_Rpc[(uint16_t)PacketType::HandShake]		= &RpcManager::HandShake;
-	m_Rpc[(uint16_t)PacketType::Acknowledge]	= &RpcManager::Acknowledge;
-	m_Rpc[(uint16_t)PacketType::Ping]			= &RpcManager::Ping;
-	m_Rpc[(uint16_t)PacketType::Movement]		= &RpcManager::MovementInput;
-}
-
-void RpcManager::Disconnect(Connection& client, NetworkMessage& data)
+void RpcManager::Disconnect(Connection& client, const ClientDisconnect& /*packet*/)
 {
 	client.m_Authorized = false;
 
-	NetworkMessage msg(PacketType::RemoveCreature, client.m_Endpoint, true);
-	msg.Write(client.m_Id);
-	//m_Network->SendToAll(msg, &client);
-
+	// Players that had us in view get RemoveCreature from InterestSystem once the entity is gone
 	m_Network->TerminateClient(client);
 }
 
-void RpcManager::HandShake(Connection& client, NetworkMessage& data)
+void RpcManager::HandShake(Connection& client, const ClientHandShake& packet)
 {
 	if (client.m_Authorized)
 	{
@@ -44,63 +36,40 @@ void RpcManager::HandShake(Connection& client, NetworkMessage& data)
 	if (Game* game = m_Network->GetGameInstance())
 	{
 		client.m_Authorized = true;
-		uint64_t time = data.ReadUint64();
-
-		client.m_RoundtripTime = m_Network->GetGameInstance()->GetElapsedTime() - time;
+		client.m_Reliability->AddRoundtripSample(RoundtripEstimator::SinceTimestamp(packet.m_Timestamp, m_ReceiveTime));
 
 		EntityManager* ecs = game->GetECS();
-		Entity entity = ecs->GetEntityFromEndpoint(client.m_Endpoint);
+		Entity entity = m_Network->GetConnections().Find(client.m_Endpoint);
 
 		Transform& transform = ecs->AddComponent(entity, Transform{});
 		Movement& movement = ecs->AddComponent(entity, Movement{});
 		movement.m_Speed = 5.f;
 		movement.m_TilePosition = transform.m_Position.ToVector2Int() * 0.01f;
 
-		std::vector<Entity> entities = ecs->GetEntities();
-		for (Entity entity : entities)
-		{
-			const Connection& other_client = ecs->GetComponent<Connection>(entity);
-			if (other_client.m_Id == client.m_Id)
-			{
-				continue;
-			}
-
-			const Transform& transform = ecs->GetComponent<Transform>(entity);
-			NetworkMessage msg(PacketType::PlayerData, client.m_Endpoint, true);
-			msg.Write(other_client.m_Id);
-			msg.Write(transform.m_Position);
-			//m_Network->Send(msg);
-		}
-
-		NetworkMessage msg(PacketType::PlayerData, client.m_Endpoint, true);
-		msg.Write(client.m_Id);
-		msg.Write(transform.m_Position);
-		//m_Network->SendToAll(msg, nullptr);
-
+		// PlayerData for us and everyone around us is sent by InterestSystem from the next tick on
 	}
 }
 
-void RpcManager::Acknowledge(Connection& client, NetworkMessage& data)
+void RpcManager::Acknowledge(Connection& /*client*/, const ClientAcknowledge& /*packet*/)
 {
-	m_Network->AckReceived(data.GetSequenceId(), client.m_Endpoint);
+	// Acks are carried in every packet header and already applied by Network::Handle,
+	// this packet type only exists for when the client has nothing else to send
 }
 
-void RpcManager::Ping(Connection& client, NetworkMessage& data)
+void RpcManager::Ping(Connection& client, const ClientPing& packet)
 {
-	uint64_t time = data.ReadUint64();
-	uint64_t elapsed_time = m_Network->GetGameInstance()->GetElapsedTime();
-
-	client.m_RoundtripTime = elapsed_time - time;
+	// The client echoes the timestamp we sent
+	client.m_Reliability->AddRoundtripSample(RoundtripEstimator::SinceTimestamp(packet.m_Timestamp, m_ReceiveTime));
 }
 
-void RpcManager::MovementInput(Connection& client, NetworkMessage& data)
+void RpcManager::MovementInput(Connection& client, const ClientMovement& packet)
 {
 	if (Game* game = m_Network->GetGameInstance())
 	{
 		EntityManager* ecs = game->GetECS();
-		Vector2 direction = data.ReadVector2();
-		
-		Entity entity = ecs->GetEntityFromEndpoint(client.m_Endpoint);
+		Vector2 direction = packet.m_Direction;
+
+		Entity entity = m_Network->GetConnections().Find(client.m_Endpoint);
 		Movement& movement = ecs->GetComponent<Movement>(entity);
 		movement.m_Direction = direction.Normalize();
 	}
@@ -1,26 +1,33 @@
 #pragma once
-#include "NetworkMessage.h"
+#include "NetworkMessageReader.h"
+#include "Packets.h"
+#include "RateLimitedLog.h"
 
 class Network;
 struct Connection;
 class RpcManager
 {
 public:
-	RpcManager(Network* network) : m_Network(network) { Init(); }
+	RpcManager(Network* network) : m_Network(network) {}
 
-	void Invoke(const PacketType& type, Connection& client, NetworkMessage& data);
+	void Invoke(const PacketType& type, Connection& client, NetworkMessageReader& data);
 
 private:
 	Network* m_Network;
-	typedef void(RpcManager::* RpcCallbacks)(Connection&, NetworkMessage&);
-	RpcCallbacks m_Rpc[(size_t)PacketType::MAX_SIZE];
+	std::chrono::steady_clock::time_point m_ReceiveTime;	// Arrival of the message being handled
+	RateLimitedLog m_Log{ 10 };
 
 private:
-	void Init();
-	void Disconnect(Connection& client, NetworkMessage& data);
-	void HandShake(Connection& client, NetworkMessage& data);
-	void Acknowledge(Connection& client, NetworkMessage& data);
-	void Ping(Connection& client, NetworkMessage& data);
-	void MovementInput(Connection& client, NetworkMessage& data);
-};
+	void Disconnect(Connection& client, const ClientDisconnect& packet);
+	void HandShake(Connection& client, const ClientHandShake& packet);
+	void Acknowledge(Connection& client, const ClientAcknowledge& packet);
+	void Ping(Connection& client, const ClientPing& packet);
+	void MovementInput(Connection& client, const ClientMovement& packet);
 
+	using Handlers = RpcDispatcher<RpcManager,
+		Rpc<ClientDisconnect, &RpcManager::Disconnect>,
+		Rpc<ClientHandShake, &RpcManager::HandShake>,
+		Rpc<ClientAcknowledge, &RpcManager::Acknowledge>,
+		Rpc<ClientPing, &RpcManager::Ping>,
+		Rpc<ClientMovement, &RpcManager::MovementInput>>;
+};